@@ -16,6 +16,7 @@ using detail::expr::expr;
 using detail::expr::len;
 using detail::expr::none;
 using detail::expr::peek;
+using detail::expr::radix;
 using detail::expr::str;
 using detail::expr::tuple;
 using detail::expr::val;
@@ -25,12 +26,14 @@ using detail::expr::vec;
 using detail::exec::Advance;
 using detail::exec::Put;
 using detail::exec::Set;
+using detail::exec::Unset;
 
 using detail::exec::Block;
 using detail::exec::If;
 using detail::exec::While;
 
 using detail::runtime::debug;
+using detail::runtime::evaluate;
 using detail::runtime::start;
 
 } // namespace gil
@@ -16,6 +16,11 @@ namespace type {
 struct None;
 struct Undefined;
 template <auto> struct Value;
+template <typename...> struct Pack;
+template <auto, typename> struct MapEntry;
+template <typename...> struct Map;
+template <unsigned long long, typename> struct MapBucket;
+template <unsigned, typename> struct Radix;
 } // namespace type
 
 namespace tfunc {
@@ -33,6 +38,10 @@ struct Len<X<Ts...>> {
   using Result = type::Value<sizeof...(Ts)>;
 };
 
+template <unsigned n, typename Root> struct Len<type::Radix<n, Root>> {
+  using Result = type::Value<n>;
+};
+
 template <typename... Xs> struct Join;
 
 template <typename X> struct Join<X> {
@@ -76,79 +85,119 @@ struct PushFront<X<Ts...>, Vs...> {
   using Result = X<Vs..., Ts...>;
 };
 
-template <typename X, unsigned n> struct Pop;
+template <unsigned... is> struct Indices {};
 
-template <typename X> struct Pop<X, 0> {
-  using Result = X;
+template <unsigned n> using MakeIndices = Indices<__integer_pack(n)...>;
+
+template <auto x> struct Box {
+  static constexpr auto value = x;
 };
 
-template <template <auto...> typename X, unsigned n>
-  requires(n > 0)
-struct Pop<X<>, n> {
-  using Result = X<>;
+template <bool cond, typename True, typename False> struct Select {
+  using Result = True;
 };
 
-template <template <auto...> typename X, auto x, auto... xs, unsigned n>
-  requires(n > 0)
-struct Pop<X<x, xs...>, n> {
-  using Result = Pop<X<xs...>, n - 1>::Result;
+template <typename True, typename False> struct Select<false, True, False> {
+  using Result = False;
 };
 
-template <template <typename...> typename X, typename T, typename... Ts,
-          unsigned n>
-  requires(n > 0)
-struct Pop<X<T, Ts...>, n> {
-  using Result = Pop<X<Ts...>, n - 1>::Result;
+template <unsigned> struct Skip {
+  using Result = void const *;
 };
 
-template <typename X, unsigned i, typename Default> struct Get;
+// Pack indexing without recursion: `Drop<MakeIndices<n>>` declares functions
+// whose first n parameters swallow the leading elements of a pack.
+template <typename> struct Drop;
 
-template <template <auto...> typename X, unsigned i, typename Default>
-struct Get<X<>, i, Default> {
-  using Result = Default;
+template <unsigned... is> struct Drop<Indices<is...>> {
+  template <typename... Ts>
+  static type::Pack<Ts...> rest(typename Skip<is>::Result..., Ts *...);
+
+  template <typename T>
+  static T first(typename Skip<is>::Result..., T *, ...);
 };
 
-template <template <auto...> typename X, auto x, auto... xs, typename Default>
-struct Get<X<x, xs...>, 0, Default> {
-  using Result = type::Value<x>;
+#if __has_builtin(__type_pack_element)
+template <unsigned i, typename... Ts>
+using Element = __type_pack_element<i, Ts...>;
+#else
+template <unsigned i, typename... Ts>
+using Element = decltype(Drop<MakeIndices<i>>::first(
+    static_cast<Ts *>(nullptr)...));
+#endif
+
+template <typename X, unsigned n> struct Pop;
+
+template <template <auto...> typename X, auto... xs, unsigned n>
+struct Pop<X<xs...>, n> {
+  template <typename> struct Unpack;
+  template <auto... ys> struct Unpack<type::Pack<Box<ys>...>> {
+    using Result = X<ys...>;
+  };
+
+  static constexpr auto drop = n < sizeof...(xs) ? n : sizeof...(xs);
+  using Result = Unpack<decltype(Drop<MakeIndices<drop>>::rest(
+      static_cast<Box<xs> *>(nullptr)...))>::Result;
 };
 
-template <template <auto...> typename X, auto x, auto... xs, unsigned i,
-          typename Default>
-struct Get<X<x, xs...>, i, Default> {
-  using Result = Get<X<xs...>, i - 1, Default>::Result;
+template <template <typename...> typename X, typename... Ts, unsigned n>
+struct Pop<X<Ts...>, n> {
+  template <typename> struct Unpack;
+  template <typename... Us> struct Unpack<type::Pack<Us...>> {
+    using Result = X<Us...>;
+  };
+
+  static constexpr auto drop = n < sizeof...(Ts) ? n : sizeof...(Ts);
+  using Result = Unpack<decltype(Drop<MakeIndices<drop>>::rest(
+      static_cast<Ts *>(nullptr)...))>::Result;
 };
 
-template <template <typename...> typename X, unsigned i, typename Default>
-struct Get<X<>, i, Default> {
+template <typename X, unsigned i, typename Default> struct Get;
+
+template <template <auto...> typename X, auto... xs, unsigned i,
+          typename Default>
+struct Get<X<xs...>, i, Default> {
   using Result = Default;
 };
 
-template <template <typename...> typename X, typename T, typename... Ts,
+template <template <auto...> typename X, auto... xs, unsigned i,
+          typename Default>
+  requires(i < sizeof...(xs))
+struct Get<X<xs...>, i, Default> {
+  using Result = type::Value<Element<i, Box<xs>...>::value>;
+};
+
+template <template <typename...> typename X, typename... Ts, unsigned i,
           typename Default>
-struct Get<X<T, Ts...>, 0, Default> {
-  using Result = T;
+struct Get<X<Ts...>, i, Default> {
+  using Result = Default;
 };
 
-template <template <typename...> typename X, typename T, typename... Ts,
-          unsigned i, typename Default>
-struct Get<X<T, Ts...>, i, Default> {
-  using Result = Get<X<Ts...>, i - 1, Default>::Result;
+template <template <typename...> typename X, typename... Ts, unsigned i,
+          typename Default>
+  requires(i < sizeof...(Ts))
+struct Get<X<Ts...>, i, Default> {
+  using Result = Element<i, Ts...>;
 };
 
-template <typename X, unsigned lo, unsigned hi> struct Slice;
+template <typename X, typename Indices> struct Take;
 
-template <template <auto...> typename X, auto... xs, unsigned lo, unsigned hi>
-  requires(lo >= hi)
-struct Slice<X<xs...>, lo, hi> {
-  using Result = X<>;
+template <template <auto...> typename X, auto... xs, unsigned... is>
+struct Take<X<xs...>, Indices<is...>> {
+  using Result = X<Element<is, Box<xs>...>::value...>;
 };
 
-template <template <auto...> typename X, auto x, auto... xs, unsigned lo,
-          unsigned hi>
-struct Slice<X<x, xs...>, lo, hi> {
+template <template <typename...> typename X, typename... Ts, unsigned... is>
+struct Take<X<Ts...>, Indices<is...>> {
+  using Result = X<Element<is, Ts...>...>;
+};
+
+template <typename X, unsigned lo, unsigned hi> struct Slice {
+  using Rest = Pop<X, lo>::Result;
+  static constexpr auto size = Len<Rest>::Result::value;
+  static constexpr auto take = lo >= hi ? 0 : hi - lo;
   using Result =
-      Join<typename Slice<X<xs...>, lo, hi - 1>::Result, X<x>>::Result;
+      Take<Rest, MakeIndices<(take < size ? take : size)>>::Result;
 };
 
 template <typename X, unsigned i, typename V> struct Set;
@@ -156,62 +205,235 @@ template <typename X, unsigned i, typename V> struct Set;
 template <template <typename...> typename X, typename... Ts, unsigned i,
           typename V>
 struct Set<X<Ts...>, i, V> {
-  using Result =
-      Join<typename Slice<X<Ts...>, 0, i>::Result, X<V>,
-           typename Slice<X<Ts...>, i + 1, sizeof...(Ts)>::Result>::Result;
+  template <typename> struct Zip;
+  template <unsigned... is> struct Zip<Indices<is...>> {
+    using Result = X<typename Select<is == i, V, Ts>::Result...>;
+  };
+
+  using Result = Zip<MakeIndices<sizeof...(Ts)>>::Result;
 };
 
 template <template <auto...> typename X, template <auto> typename V, auto... xs,
           unsigned i, auto x>
 struct Set<X<xs...>, i, V<x>> {
-  using Result =
-      Join<typename Slice<X<xs...>, 0, i>::Result, X<x>,
-           typename Slice<X<xs...>, i + 1, sizeof...(xs)>::Result>::Result;
+  template <typename> struct Zip;
+  template <unsigned... is> struct Zip<Indices<is...>> {
+    using Result =
+        X<Select<is == i, Box<x>, Box<xs>>::Result::value...>;
+  };
+
+  using Result = Zip<MakeIndices<sizeof...(xs)>>::Result;
 };
 
 template <typename Map, auto key, typename Default> struct GetItem;
 
-template <template <typename...> typename Map, auto key, typename Default>
-struct GetItem<Map<>, key, Default> {
+template <auto key, typename Default>
+struct GetItem<type::Pack<>, key, Default> {
   using Result = Default;
 };
 
-template <template <typename...> typename Map,
-          template <auto, typename> typename Entry, typename... Entries, auto k,
+template <template <auto, typename> typename Entry, typename... Entries, auto k,
           typename V, auto key, typename Default>
   requires(k == key)
-struct GetItem<Map<Entry<k, V>, Entries...>, key, Default> {
+struct GetItem<type::Pack<Entry<k, V>, Entries...>, key, Default> {
   using Result = V;
 };
 
-template <template <typename...> typename Map, typename Entry,
-          typename... Entries, auto key, typename Default>
-struct GetItem<Map<Entry, Entries...>, key, Default> {
-  using Result = GetItem<Map<Entries...>, key, Default>::Result;
+template <typename Entry, typename... Entries, auto key, typename Default>
+struct GetItem<type::Pack<Entry, Entries...>, key, Default> {
+  using Result = GetItem<type::Pack<Entries...>, key, Default>::Result;
 };
 
 template <typename Map, typename Entry> struct SetItem;
 
-template <template <typename...> typename Map,
-          template <auto, typename> typename Entry, auto key, typename V>
-struct SetItem<Map<>, Entry<key, V>> {
-  using Result = Map<Entry<key, V>>;
+template <template <auto, typename> typename Entry, auto key, typename V>
+struct SetItem<type::Pack<>, Entry<key, V>> {
+  using Result = type::Pack<Entry<key, V>>;
 };
 
-template <template <typename...> typename Map,
-          template <auto, typename> typename Entry, typename... Entries,
+template <template <auto, typename> typename Entry, typename... Entries,
           auto key, typename V, typename W>
-struct SetItem<Map<Entry<key, W>, Entries...>, Entry<key, V>> {
-  using Result = Map<Entry<key, V>, Entries...>;
+struct SetItem<type::Pack<Entry<key, W>, Entries...>, Entry<key, V>> {
+  using Result = type::Pack<Entry<key, V>, Entries...>;
 };
 
-template <template <typename...> typename Map,
-          template <auto, typename> typename Entry, typename Head,
+template <template <auto, typename> typename Entry, typename Head,
           typename... Entries, auto key, typename V>
-struct SetItem<Map<Head, Entries...>, Entry<key, V>> {
+struct SetItem<type::Pack<Head, Entries...>, Entry<key, V>> {
   using Result =
-      Join<Map<Head>,
-           typename SetItem<Map<Entries...>, Entry<key, V>>::Result>::Result;
+      Join<type::Pack<Head>, typename SetItem<type::Pack<Entries...>,
+                                              Entry<key, V>>::Result>::Result;
+};
+
+template <typename Map, auto key> struct DelItem;
+
+template <auto key> struct DelItem<type::Pack<>, key> {
+  using Result = type::Pack<>;
+};
+
+template <template <auto, typename> typename Entry, typename... Entries, auto k,
+          typename V, auto key>
+  requires(k == key)
+struct DelItem<type::Pack<Entry<k, V>, Entries...>, key> {
+  using Result = type::Pack<Entries...>;
+};
+
+template <typename Entry, typename... Entries, auto key>
+struct DelItem<type::Pack<Entry, Entries...>, key> {
+  using Result =
+      Join<type::Pack<Entry>,
+           typename DelItem<type::Pack<Entries...>, key>::Result>::Result;
+};
+
+// Keys that convert to integers hash to their value, so that keys comparing
+// equal across integral and enum types land in the same bucket. Any other key
+// is hashed by its spelling as a template argument.
+template <auto key> constexpr unsigned long long hash_of() noexcept {
+  if constexpr (requires { static_cast<unsigned long long>(key); }) {
+    return static_cast<unsigned long long>(key);
+  } else {
+    unsigned long long hash = 0xcbf29ce484222325ull;
+    for (char const *ch = __PRETTY_FUNCTION__; *ch; ++ch)
+      hash = (hash ^ static_cast<unsigned char>(*ch)) * 0x100000001b3ull;
+    return hash;
+  }
+}
+
+template <auto key> static constexpr auto hash = hash_of<key>();
+
+static constexpr unsigned map_bits = 4;
+
+template <unsigned long long hash, unsigned depth>
+static constexpr unsigned map_slot =
+    (hash >> (map_bits * depth)) & ((1u << map_bits) - 1);
+
+using MapBranch = type::Map<type::Map<>, type::Map<>, type::Map<>, type::Map<>,
+                            type::Map<>, type::Map<>, type::Map<>, type::Map<>,
+                            type::Map<>, type::Map<>, type::Map<>, type::Map<>,
+                            type::Map<>, type::Map<>, type::Map<>, type::Map<>>;
+
+template <typename Node, unsigned long long hash, unsigned depth, auto key,
+          typename Default>
+struct Lookup;
+
+template <unsigned long long hash, unsigned depth, auto key, typename Default>
+struct Lookup<type::Map<>, hash, depth, key, Default> {
+  using Result = Default;
+};
+
+template <typename... Slots, unsigned long long hash, unsigned depth, auto key,
+          typename Default>
+  requires(sizeof...(Slots) > 0)
+struct Lookup<type::Map<Slots...>, hash, depth, key, Default> {
+  using Result = Lookup<typename Get<type::Map<Slots...>, map_slot<hash, depth>,
+                                     type::Map<>>::Result,
+                        hash, depth + 1, key, Default>::Result;
+};
+
+template <unsigned long long bucket, typename Entries, unsigned long long hash,
+          unsigned depth, auto key, typename Default>
+struct Lookup<type::MapBucket<bucket, Entries>, hash, depth, key, Default> {
+  using Result = GetItem<Entries, key, Default>::Result;
+};
+
+template <typename Node, unsigned long long hash, unsigned depth,
+          typename Entry>
+struct Insert;
+
+template <unsigned long long hash, unsigned depth, typename Entry>
+struct Insert<type::Map<>, hash, depth, Entry> {
+  using Result = type::MapBucket<hash, type::Pack<Entry>>;
+};
+
+template <typename... Slots, unsigned long long hash, unsigned depth,
+          typename Entry>
+  requires(sizeof...(Slots) > 0)
+struct Insert<type::Map<Slots...>, hash, depth, Entry> {
+  static constexpr auto slot = map_slot<hash, depth>;
+  using Result =
+      Set<type::Map<Slots...>, slot,
+          typename Insert<typename Get<type::Map<Slots...>, slot,
+                                       type::Map<>>::Result,
+                          hash, depth + 1, Entry>::Result>::Result;
+};
+
+template <unsigned long long hash, typename Entries, unsigned depth,
+          typename Entry>
+struct Insert<type::MapBucket<hash, Entries>, hash, depth, Entry> {
+  using Result =
+      type::MapBucket<hash, typename SetItem<Entries, Entry>::Result>;
+};
+
+template <unsigned long long bucket, typename Entries, unsigned long long hash,
+          unsigned depth, typename Entry>
+  requires(bucket != hash)
+struct Insert<type::MapBucket<bucket, Entries>, hash, depth, Entry> {
+  using Split = Set<MapBranch, map_slot<bucket, depth>,
+                    type::MapBucket<bucket, Entries>>::Result;
+  using Result = Insert<Split, hash, depth, Entry>::Result;
+};
+
+// Empties buckets and branches as their last entry goes, so that a map that
+// had everything removed is `type::Map<>` again.
+template <typename Node, unsigned long long hash, unsigned depth, auto key>
+struct Remove {
+  using Result = Node;
+};
+
+template <typename... Slots, unsigned long long hash, unsigned depth, auto key>
+  requires(sizeof...(Slots) > 0)
+struct Remove<type::Map<Slots...>, hash, depth, key> {
+  static constexpr auto slot = map_slot<hash, depth>;
+  using Removed =
+      Set<type::Map<Slots...>, slot,
+          typename Remove<typename Get<type::Map<Slots...>, slot,
+                                       type::Map<>>::Result,
+                          hash, depth + 1, key>::Result>::Result;
+  using Result = Select<__is_same(Removed, MapBranch), type::Map<>,
+                        Removed>::Result;
+};
+
+template <unsigned long long hash, typename Entries, unsigned depth, auto key>
+struct Remove<type::MapBucket<hash, Entries>, hash, depth, key> {
+  using Left = DelItem<Entries, key>::Result;
+  using Result = Select<__is_same(Left, type::Pack<>), type::Map<>,
+                        type::MapBucket<hash, Left>>::Result;
+};
+
+template <typename... Slots, auto key, typename Default>
+struct GetItem<type::Map<Slots...>, key, Default> {
+  using Result =
+      Lookup<type::Map<Slots...>, hash<key>, 0, key, Default>::Result;
+};
+
+template <unsigned long long bucket, typename Entries, auto key,
+          typename Default>
+struct GetItem<type::MapBucket<bucket, Entries>, key, Default> {
+  using Result = Lookup<type::MapBucket<bucket, Entries>, hash<key>, 0, key,
+                        Default>::Result;
+};
+
+template <typename... Slots, auto key, typename V>
+struct SetItem<type::Map<Slots...>, type::MapEntry<key, V>> {
+  using Result = Insert<type::Map<Slots...>, hash<key>, 0,
+                        type::MapEntry<key, V>>::Result;
+};
+
+template <unsigned long long bucket, typename Entries, auto key, typename V>
+struct SetItem<type::MapBucket<bucket, Entries>, type::MapEntry<key, V>> {
+  using Result = Insert<type::MapBucket<bucket, Entries>, hash<key>, 0,
+                        type::MapEntry<key, V>>::Result;
+};
+
+template <typename... Slots, auto key>
+struct DelItem<type::Map<Slots...>, key> {
+  using Result = Remove<type::Map<Slots...>, hash<key>, 0, key>::Result;
+};
+
+template <unsigned long long bucket, typename Entries, auto key>
+struct DelItem<type::MapBucket<bucket, Entries>, key> {
+  using Result =
+      Remove<type::MapBucket<bucket, Entries>, hash<key>, 0, key>::Result;
 };
 
 } // namespace _impl_
@@ -243,6 +465,9 @@ using GetItem = _impl_::GetItem<Map, key, Default>::Result;
 template <typename Map, typename Entry>
 using SetItem = _impl_::SetItem<Map, Entry>::Result;
 
+template <typename Map, auto key>
+using DelItem = _impl_::DelItem<Map, key>::Result;
+
 } // namespace tfunc
 
 namespace type {
@@ -326,17 +551,188 @@ template <typename...> struct Pack {};
 
 template <auto key, typename V> struct MapEntry {};
 
+// Persistent hash trie keyed on `tfunc::_impl_::hash`: a node is either empty
+// (`Map<>`), a full branch of `Map`s, or a bucket of entries sharing a hash.
+template <typename...> struct Map {};
+
+template <unsigned long long hash, typename Entries> struct MapBucket {};
+
+namespace _impl_ {
+
+static constexpr unsigned radix_bits = 4;
+static constexpr unsigned radix_width = 1u << radix_bits;
+
+constexpr unsigned radix_height(unsigned n) noexcept {
+  unsigned height = 0;
+  for (unsigned long long capacity = radix_width; capacity < n;
+       capacity *= radix_width)
+    ++height;
+  return height;
+}
+
+template <unsigned i, unsigned height>
+static constexpr unsigned radix_slot =
+    (i >> (radix_bits * height)) % radix_width;
+
+template <typename Node, unsigned height, unsigned i> struct RadixGet {
+  using Result = RadixGet<tfunc::Get<Node, radix_slot<i, height>>, height - 1,
+                          i>::Result;
+};
+
+template <typename Leaf, unsigned i> struct RadixGet<Leaf, 0, i> {
+  using Result = tfunc::Get<Leaf, radix_slot<i, 0>>;
+};
+
+template <typename Node, unsigned height, unsigned i, typename V>
+struct RadixSet {
+  static constexpr auto slot = radix_slot<i, height>;
+  using Result =
+      tfunc::Set<Node, slot,
+                 typename RadixSet<tfunc::Get<Node, slot>, height - 1, i,
+                                   V>::Result>;
+};
+
+template <typename Leaf, unsigned i, typename V>
+struct RadixSet<Leaf, 0, i, V> {
+  using Result = tfunc::Set<Leaf, radix_slot<i, 0>, V>;
+};
+
+template <unsigned height, typename V> struct RadixPath {
+  using Result = Pack<typename RadixPath<height - 1, V>::Result>;
+};
+
+template <template <auto> typename V, auto x> struct RadixPath<0, V<x>> {
+  using Result = Tuple<x>;
+};
+
+template <typename Node, unsigned height, unsigned i, typename V>
+struct RadixPush {
+  using Result =
+      tfunc::Push<Node, typename RadixPath<height - 1, V>::Result>;
+};
+
+template <typename Node, unsigned height, unsigned i, typename V>
+  requires(height > 0 && radix_slot<i, height> < tfunc::Len<Node>::value)
+struct RadixPush<Node, height, i, V> {
+  static constexpr auto slot = radix_slot<i, height>;
+  using Result =
+      tfunc::Set<Node, slot,
+                 typename RadixPush<tfunc::Get<Node, slot>, height - 1, i,
+                                    V>::Result>;
+};
+
+template <typename Leaf, unsigned i, typename V>
+struct RadixPush<Leaf, 0, i, V> {
+  using Result = tfunc::Push<Leaf, V>;
+};
+
+template <typename Level, typename Chunks> struct RadixChunk;
+
+template <typename Level, unsigned... js>
+struct RadixChunk<Level, tfunc::_impl_::Indices<js...>> {
+  using Result =
+      Pack<tfunc::Slice<Level, js * radix_width, (js + 1) * radix_width>...>;
+};
+
+template <typename Level>
+using RadixChunks = RadixChunk<
+    Level, tfunc::_impl_::MakeIndices<(tfunc::Len<Level>::value +
+                                       radix_width - 1) /
+                                      radix_width>>::Result;
+
+template <typename Level> struct RadixBuild {
+  using Result = RadixBuild<RadixChunks<Level>>::Result;
+};
+
+template <typename... Nodes>
+  requires(sizeof...(Nodes) <= radix_width)
+struct RadixBuild<Pack<Nodes...>> {
+  using Result = Pack<Nodes...>;
+};
+
+template <auto... xs>
+  requires(sizeof...(xs) <= radix_width)
+struct RadixBuild<Tuple<xs...>> {
+  using Result = Tuple<xs...>;
+};
+
+template <typename Node, unsigned height> struct RadixItems;
+
+template <typename... Nodes, unsigned height>
+struct RadixItems<Pack<Nodes...>, height> {
+  using Result =
+      tfunc::Join<typename RadixItems<Nodes, height - 1>::Result...>;
+};
+
+template <auto... xs> struct RadixItems<Tuple<xs...>, 0> {
+  using Result = Tuple<xs...>;
+};
+
+template <typename Items>
+using RadixFrom =
+    Radix<tfunc::Len<Items>::value, typename RadixBuild<Items>::Result>;
+
+} // namespace _impl_
+
+// Persistent vector stored as a shallow radix tree: leaves are `Tuple`s and
+// branches are `Pack`s of at most `radix_width` children, so that updating
+// or appending an element only rebuilds one root-to-leaf path.
+template <unsigned n, typename Root> struct Radix {
+  static constexpr auto height = _impl_::radix_height(n);
+  using Items = _impl_::RadixItems<Root, height>::Result;
+
+  template <template <auto...> typename Y, auto... ys>
+  constexpr auto operator+(Y<ys...>) const noexcept {
+    if constexpr (sizeof...(ys) != 1)
+      return _impl_::RadixFrom<tfunc::Join<Items, Tuple<ys...>>>{};
+    else if constexpr (_impl_::radix_height(n + 1) > height)
+      return Radix<n + 1, Pack<Root, typename _impl_::RadixPath<
+                                         height, Value<ys...>>::Result>>{};
+    else
+      return Radix<n + 1, typename _impl_::RadixPush<Root, height, n,
+                                                     Value<ys...>>::Result>{};
+  }
+  template <unsigned m, typename Other>
+  constexpr auto operator+(Radix<m, Other>) const noexcept {
+    return _impl_::RadixFrom<
+        tfunc::Join<Items, typename Radix<m, Other>::Items>>{};
+  }
+  template <template <auto> typename V, auto i>
+  constexpr auto operator[](V<i>) const noexcept {
+    if constexpr (i < n)
+      return typename _impl_::RadixGet<Root, height, i>::Result{};
+    else
+      return tfunc::Get<Tuple<>, i>{};
+  }
+  template <template <auto> typename V, auto i, template <auto> typename Y,
+            auto y>
+  constexpr auto operator()(V<i>, Y<y>) const noexcept {
+    if constexpr (i < n)
+      return Radix<n, typename _impl_::RadixSet<Root, height, i,
+                                                Value<y>>::Result>{};
+    else
+      return Radix<n, Root>{};
+  }
+};
+
+template <auto... xs>
+using RadixVector = _impl_::RadixFrom<Tuple<xs...>>;
+
 } // namespace type
 
 namespace string {
 
 template <unsigned n> struct StringLiteral {
   char str[n + 1];
-  constexpr StringLiteral(char const *ptr) noexcept {
-    for (unsigned i = 0; i < n; ++i)
-      str[i] = ptr[i];
-    str[n] = '\0';
-  }
+  constexpr StringLiteral(char const *ptr) noexcept
+      : StringLiteral(ptr, tfunc::_impl_::MakeIndices<n>{}) {}
+  template <unsigned... is>
+  constexpr StringLiteral(char const *ptr,
+                          tfunc::_impl_::Indices<is...>) noexcept
+      : str{ptr[is]..., '\0'} {}
+  template <template <char...> typename S, char... cs>
+    requires(sizeof...(cs) == n)
+  constexpr StringLiteral(S<cs...>) noexcept : str{cs..., '\0'} {}
   static constexpr unsigned size = n;
 
   constexpr auto operator[](unsigned idx) const noexcept { return str[idx]; }
@@ -346,48 +742,213 @@ template <unsigned n> StringLiteral(char const (&)[n]) -> StringLiteral<n - 1>;
 
 template <char... cs> using String = type::Vector<char, cs...>;
 
+// Append-only output buffer. The first chunk is the one being written to;
+// once it holds `rope_chunk` characters it is moved behind the completed
+// chunks, so that each write copies at most one chunk.
+template <typename Open, typename... Chunks> struct Rope {};
+
+static constexpr unsigned rope_chunk = 64;
+
 namespace _impl_ {
-template <unsigned n, StringLiteral<n> str, unsigned m> struct SplitFrom {
-  using Result = tfunc::PushFront<typename SplitFrom<n, str, m + 1>::Result,
-                                  type::Value<str.str[m]>>;
+
+template <auto str, typename Indices> struct Split;
+
+template <auto str, unsigned... is>
+struct Split<str, tfunc::_impl_::Indices<is...>> {
+  using Result = String<str.str[is]...>;
+};
+
+template <typename Rope, typename... Vs> struct Append;
+
+template <typename Open, typename... Chunks>
+struct Append<Rope<Open, Chunks...>> {
+  using Result = Rope<Open, Chunks...>;
 };
 
-template <unsigned n, StringLiteral<n> str, unsigned m>
-  requires(m >= n)
-struct SplitFrom<n, str, m> {
-  using Result = String<>;
+template <char... cs, typename... Chunks, template <auto> typename V, auto v,
+          typename... Vs>
+struct Append<Rope<String<cs...>, Chunks...>, V<v>, Vs...> {
+  using Result = Append<Rope<String<cs..., v>, Chunks...>, Vs...>::Result;
+};
+
+template <char... cs, typename... Chunks, template <auto> typename V, auto v,
+          typename... Vs>
+  requires(sizeof...(cs) >= rope_chunk)
+struct Append<Rope<String<cs...>, Chunks...>, V<v>, Vs...> {
+  using Result =
+      Append<Rope<String<v>, Chunks..., String<cs...>>, Vs...>::Result;
 };
 
 template <typename String> struct Join;
 
 template <char... cs> struct Join<String<cs...>> {
+  static constexpr auto result = StringLiteral<sizeof...(cs)>(String<cs...>{});
+};
+
+template <typename Open, typename... Chunks>
+struct Join<Rope<Open, Chunks...>> {
+  static constexpr unsigned size =
+      (tfunc::Len<Chunks>::value + ... + tfunc::Len<Open>::value);
+
   static constexpr auto result = [] {
-    char result[] = {cs..., '\0'};
-    return StringLiteral(result);
+    char result[size + 1]{};
+    unsigned idx = 0;
+    auto write = [&]<char... cs>(String<cs...>) {
+      ((result[idx++] = cs), ...);
+    };
+    (write(Chunks{}), ..., write(Open{}));
+    return StringLiteral<size>(result);
   }();
 };
 
 } // namespace _impl_
 
 template <StringLiteral str>
-using ToString = _impl_::SplitFrom<str.size, str, 0>::Result;
+using ToString =
+    _impl_::Split<str, tfunc::_impl_::MakeIndices<str.size>>::Result;
+
+template <typename Rope, typename... Vs>
+using Append = _impl_::Append<Rope, Vs...>::Result;
 
 template <typename String>
 static constexpr auto as_literal = _impl_::Join<String>::result;
 
 } // namespace string
 
+namespace value {
+
+// Not constexpr: reaching this during constant evaluation is a compile error
+// that names the unsupported operation.
+[[noreturn]] inline void fault(char const *) noexcept { __builtin_trap(); }
+
+enum class Kind : unsigned char { None, Int, Seq };
+
+// A value of the abstract machine, as held by `runtime::Machine`: either
+// `type::None`, an integer (kept as a `long long`), or a sequence of at most
+// `capacity` integers standing in for a `Tuple`, `Vector` or `Radix`.
+template <unsigned capacity> struct Datum {
+  Kind kind = Kind::None;
+  long long x = 0;
+  unsigned size = 0;
+  long long items[capacity]{};
+
+  template <typename T> static constexpr Datum of(T const &t) noexcept {
+    if constexpr (requires { static_cast<long long>(t); })
+      return {Kind::Int, static_cast<long long>(t)};
+    else
+      static_assert(false && sizeof(T), "Value not supported by the machine");
+  }
+
+  template <typename... Ts> static constexpr Datum seq(Ts const &...ts) noexcept {
+    static_assert(sizeof...(Ts) <= capacity,
+                  "Sequence does not fit in the machine");
+    return {Kind::Seq, 0, sizeof...(Ts), {of(ts).x...}};
+  }
+
+  constexpr long long scalar() const noexcept {
+    if (kind != Kind::Int)
+      fault("arithmetic on a value that is not an integer");
+    return x;
+  }
+
+  constexpr explicit operator bool() const noexcept { return scalar() != 0; }
+
+  constexpr Datum length() const noexcept {
+    if (kind == Kind::None)
+      fault("length of none");
+    return of(kind == Kind::Seq ? size : 1u);
+  }
+
+  constexpr bool same(Datum const &rhs) const noexcept {
+    if (kind == Kind::None || rhs.kind == Kind::None)
+      return kind == rhs.kind;
+    if (kind != rhs.kind)
+      fault("comparison of a sequence with an integer");
+    if (kind == Kind::Int)
+      return x == rhs.x;
+    if (size != rhs.size)
+      return false;
+    for (unsigned i = 0; i < size; ++i)
+      if (items[i] != rhs.items[i])
+        return false;
+    return true;
+  }
+
+  // Appends an integer, or every element of a sequence.
+  constexpr Datum concat(Datum const &rhs) const noexcept {
+    auto result = *this;
+    auto const n = rhs.kind == Kind::Seq ? rhs.size : 1u;
+    if (size + n > capacity)
+      fault("sequence does not fit in the machine");
+    for (unsigned i = 0; i < n; ++i)
+      result.items[result.size++] =
+          rhs.kind == Kind::Seq ? rhs.items[i] : rhs.scalar();
+    return result;
+  }
+
+  template <string::StringLiteral op, typename Apply>
+  constexpr Datum binary(Datum const &rhs, Apply apply) const noexcept {
+    if constexpr (op.size == 2 && op[1] == '=' && (op[0] == '=' || op[0] == '!'))
+      return of(same(rhs) == (op[0] == '='));
+    else if constexpr (op.size == 1 && op[0] == '+')
+      return kind == Kind::Seq ? concat(rhs)
+                               : of(apply(scalar(), rhs.scalar()));
+    else
+      return of(apply(scalar(), rhs.scalar()));
+  }
+
+  constexpr Datum operator+() const noexcept { return of(+scalar()); }
+  constexpr Datum operator-() const noexcept { return of(-scalar()); }
+  constexpr Datum operator~() const noexcept { return of(~scalar()); }
+  constexpr Datum operator!() const noexcept { return of(!scalar()); }
+
+#define PURE_BIN_OP(O)                                                         \
+  constexpr Datum operator O(Datum const &rhs) const noexcept {                \
+    return binary<#O>(rhs, [](auto lhs, auto rhs) { return lhs O rhs; });      \
+  }
+#include "ops.inc"
+
+  constexpr Datum operator[](Datum const &i) const noexcept {
+    if (kind != Kind::Seq)
+      fault("subscript of a value that is not a sequence");
+    if (i.scalar() < 0 || i.x >= size)
+      fault("subscript out of range");
+    return of(items[i.x]);
+  }
+
+  constexpr Datum operator()(Datum const &i, Datum const &y) const noexcept {
+    if (kind != Kind::Seq)
+      fault("update of a value that is not a sequence");
+    auto result = *this;
+    if (i.scalar() >= 0 && i.x < size)
+      result.items[i.x] = y.scalar();
+    return result;
+  }
+};
+
+} // namespace value
+
 namespace expr {
 
 template <typename Runtime, auto expr>
 using Eval = decltype(expr)::template Eval<Runtime>;
 
+template <auto expr, typename Machine>
+constexpr auto eval(Machine const &machine) noexcept {
+  return decltype(expr)::eval(machine);
+}
+
 namespace _impl_ {
 
 template <auto op, typename... Args> struct Expr {
   template <typename Runtime>
   using Eval = decltype(op(typename Args::template Eval<Runtime>{}...));
 
+  template <typename Machine>
+  static constexpr auto eval(Machine const &machine) noexcept {
+    return op(Args::eval(machine)...);
+  }
+
 #define UN_OP(O)                                                               \
   constexpr auto operator O() const noexcept {                                 \
     return Expr<[](auto self) { return O self; }, Expr<op, Args...>>{};        \
@@ -417,37 +978,87 @@ template <typename E> static constexpr auto expr = Expr<id, E>{};
 
 struct None {
   template <typename Runtime> using Eval = type::None;
+
+  template <typename Machine>
+  static constexpr auto eval(Machine const &) noexcept {
+    return typename Machine::Datum{};
+  }
 };
 
 template <auto value> struct Val {
   template <typename Runtime> using Eval = type::Value<value>;
+
+  template <typename Machine>
+  static constexpr auto eval(Machine const &) noexcept {
+    return Machine::Datum::of(value);
+  }
 };
 
 template <auto... xs> struct Tuple {
   template <typename Runtime> using Eval = type::Tuple<xs...>;
+
+  template <typename Machine>
+  static constexpr auto eval(Machine const &) noexcept {
+    return Machine::Datum::seq(xs...);
+  }
 };
 
 template <typename T, T... ts> struct Vec {
   template <typename Runtime> using Eval = type::Vector<T, ts...>;
+
+  template <typename Machine>
+  static constexpr auto eval(Machine const &) noexcept {
+    return Machine::Datum::seq(ts...);
+  }
+};
+
+template <auto... xs> struct Radix {
+  template <typename Runtime> using Eval = type::RadixVector<xs...>;
+
+  template <typename Machine>
+  static constexpr auto eval(Machine const &) noexcept {
+    return Machine::Datum::seq(xs...);
+  }
 };
 
 template <string::StringLiteral s> struct Str {
   template <typename Runtime> using Eval = string::ToString<s>;
+
+  template <typename Machine>
+  static constexpr auto eval(Machine const &) noexcept {
+    return []<unsigned... is>(tfunc::_impl_::Indices<is...>) {
+      return Machine::Datum::seq(s.str[is]...);
+    }(tfunc::_impl_::MakeIndices<s.size>{});
+  }
 };
 
 template <auto var> struct Var {
   template <typename Runtime>
   using Eval = tfunc::GetItem<typename Runtime::State, var>;
+
+  template <typename Machine>
+  static constexpr auto eval(Machine const &machine) noexcept {
+    return machine.template get<var>();
+  }
 };
 
 template <auto expr> struct Peek {
   template <typename Runtime>
-  using Eval = tfunc::Get<typename Runtime::Stdin, Eval<Runtime, expr>::value,
-                          type::None>;
+  using Eval = Runtime::template Peek<Eval<Runtime, expr>::value>;
+
+  template <typename Machine>
+  static constexpr auto eval(Machine const &machine) noexcept {
+    return machine.peek(decltype(expr)::eval(machine));
+  }
 };
 
 template <auto expr> struct Len {
   template <typename Runtime> using Eval = tfunc::Len<Eval<Runtime, expr>>;
+
+  template <typename Machine>
+  static constexpr auto eval(Machine const &machine) noexcept {
+    return decltype(expr)::eval(machine).length();
+  }
 };
 
 } // namespace _impl_
@@ -460,6 +1071,8 @@ template <auto... xs>
 static constexpr auto tuple = _impl_::expr<_impl_::Tuple<xs...>>;
 template <typename T, T... ts>
 static constexpr auto vec = _impl_::expr<_impl_::Vec<T, ts...>>;
+template <auto... xs>
+static constexpr auto radix = _impl_::expr<_impl_::Radix<xs...>>;
 template <string::StringLiteral s>
 static constexpr auto str = _impl_::expr<_impl_::Str<s>>;
 template <auto v> static constexpr auto var = _impl_::expr<_impl_::Var<v>>;
@@ -476,31 +1089,64 @@ template <auto var, auto expr> struct Set {
   template <typename Runtime>
   using Run = Runtime::template WithState<tfunc::SetItem<
       typename Runtime::State, type::MapEntry<var, expr::Eval<Runtime, expr>>>>;
+
+  template <typename Machine> static constexpr void run(Machine &machine) {
+    machine.template set<var>(expr::eval<expr>(machine));
+  }
+};
+
+template <auto var> struct Unset {
+  template <typename Runtime>
+  using Run = Runtime::template WithState<
+      tfunc::DelItem<typename Runtime::State, var>>;
+
+  template <typename Machine> static constexpr void run(Machine &machine) {
+    machine.template unset<var>();
+  }
 };
 
 template <auto expr = expr::val<1u>> struct Advance {
   template <typename Runtime>
-  using Run = Runtime::template WithStdin<
-      tfunc::Pop<typename Runtime::Stdin, expr::Eval<Runtime, expr>::value>>;
+  using Run =
+      Runtime::template WithAdvance<expr::Eval<Runtime, expr>::value>;
+
+  template <typename Machine> static constexpr void run(Machine &machine) {
+    machine.advance(expr::eval<expr>(machine));
+  }
 };
 
 template <auto... exprs> struct Put {
   template <typename Runtime>
-  using Run = Runtime::template WithStdout<
-      tfunc::Push<typename Runtime::Stdout, expr::Eval<Runtime, exprs>...>>;
+  using Run = Runtime::template WithStdout<string::Append<
+      typename Runtime::Stdout, expr::Eval<Runtime, exprs>...>>;
+
+  template <typename Machine> static constexpr void run(Machine &machine) {
+    (machine.put(expr::eval<exprs>(machine)), ...);
+  }
 };
 
-template <typename... Instructions> struct Block;
+namespace _impl_ {
 
-template <> struct Block<> {
-  template <typename Runtime> using Run = Runtime;
+// Threads a runtime through a fold over `|`, so that a block of n
+// instructions is run without nesting one instantiation per instruction.
+template <typename Runtime> struct Chain {
+  using Result = Runtime;
 };
 
-template <typename Instruction, typename... Instructions>
-struct Block<Instruction, Instructions...> {
+template <typename Runtime, typename Instruction>
+auto operator|(Chain<Runtime>, Instruction *)
+    -> Chain<typename Instruction::template Run<Runtime>>;
+
+} // namespace _impl_
+
+template <typename... Instructions> struct Block {
   template <typename Runtime>
-  using Run = Block<Instructions...>::template Run<
-      typename Instruction::template Run<Runtime>>;
+  using Run = decltype((_impl_::Chain<Runtime>{} | ... |
+                        static_cast<Instructions *>(nullptr)))::Result;
+
+  template <typename Machine> static constexpr void run(Machine &machine) {
+    (Instructions::run(machine), ...);
+  }
 };
 
 namespace _impl_ {
@@ -521,32 +1167,121 @@ template <auto expr, typename Then, typename Else = Block<>> struct If {
   using Run =
       _impl_::Branch<static_cast<bool>(expr::Eval<Runtime, expr>::value), Then,
                      Else>::Result::template Run<Runtime>;
+
+  template <typename Machine> static constexpr void run(Machine &machine) {
+    if (static_cast<bool>(expr::eval<expr>(machine)))
+      Then::run(machine);
+    else
+      Else::run(machine);
+  }
+};
+
+namespace _impl_ {
+
+// Runs at most 2^k iterations of a loop, stopping early once `expr` fails, so
+// that a loop of n iterations only nests O(log n) instantiations deep.
+template <unsigned k, auto expr, typename Loop, typename Runtime>
+struct Iterate;
+
+template <bool done, unsigned k, auto expr, typename Loop, typename First>
+struct IterateRest {
+  using Result = First;
+};
+
+template <unsigned k, auto expr, typename Loop, typename First>
+struct IterateRest<false, k, expr, Loop, First> {
+  using Result = Iterate<k, expr, Loop, typename First::Result>;
 };
 
+template <unsigned k, auto expr, typename Loop, typename Runtime>
+struct Iterate {
+  using Rest = IterateRest<Iterate<k - 1, expr, Loop, Runtime>::done, k - 1,
+                           expr, Loop, Iterate<k - 1, expr, Loop, Runtime>>::
+      Result;
+
+  using Result = Rest::Result;
+  static constexpr bool done = Rest::done;
+};
+
+template <auto expr, typename Loop, typename Runtime>
+struct Iterate<0, expr, Loop, Runtime> {
+  static constexpr bool done =
+      !static_cast<bool>(expr::Eval<Runtime, expr>::value);
+
+  using Result = Branch<done, Block<>, Loop>::Result::template Run<Runtime>;
+};
+
+template <unsigned k, auto expr, typename Loop, typename Runtime> struct Drive {
+  using Batch = Iterate<k, expr, Loop, Runtime>;
+
+  using Result = Branch<Batch::done, Batch,
+                        Drive<k + 1, expr, Loop, typename Batch::Result>>::
+      Result::Result;
+};
+
+} // namespace _impl_
+
 template <auto expr, typename Loop> struct While {
   template <typename Runtime>
-  using Run = If<expr, Block<Loop, While<expr, Loop>>>::template Run<Runtime>;
+  using Run = _impl_::Drive<0, expr, Loop, Runtime>::Result;
+
+  template <typename Machine> static constexpr void run(Machine &machine) {
+    // Nested so that no single loop runs into `-fconstexpr-loop-limit`.
+    for (;;)
+      for (unsigned step = 0; step < (1u << 16); ++step) {
+        if (!static_cast<bool>(expr::eval<expr>(machine)))
+          return;
+        Loop::run(machine);
+      }
+  }
 };
 
 } // namespace exec
 
 namespace runtime {
 
-template <typename S, typename I, typename O> struct Runtime {
+// The whole of stdin is kept in one shared literal; a runtime only records
+// how far into it the program has read.
+#ifdef __STDIN__
+static constexpr string::StringLiteral input = __STDIN__;
+#else
+// Not run by the abstract system emulator driver, so there is no stdin to
+// read at compile time.
+static constexpr string::StringLiteral input = "";
+#endif
+
+namespace _impl_ {
+
+template <unsigned i, typename Default> struct Peek {
+  using Result = Default;
+};
+
+template <unsigned i, typename Default>
+  requires(i < input.size)
+struct Peek<i, Default> {
+  using Result = type::Value<input[i]>;
+};
+
+} // namespace _impl_
+
+template <typename S, unsigned I, typename O> struct Runtime {
   using State = S;
-  using Stdin = I;
+  static constexpr unsigned cursor = I;
   using Stdout = O;
 
+  template <unsigned offset, typename Default = type::None>
+  using Peek = _impl_::Peek<I + offset, Default>::Result;
+
   template <typename SS> using WithState = Runtime<SS, I, O>;
-  template <typename II> using WithStdin = Runtime<S, II, O>;
+  template <unsigned n>
+  using WithAdvance = Runtime<S, (I + n < input.size ? I + n : input.size), O>;
   template <typename OO> using WithStdout = Runtime<S, I, OO>;
 
   template <typename... Instructions>
   using Run = exec::Block<Instructions...>::template Run<Runtime<S, I, O>>;
 };
 
-using Start =
-    Runtime<type::Pack<>, string::ToString<__STDIN__>, string::String<>>;
+using Start = Runtime<type::Map<>, 0, string::Rope<string::String<>>>;
 
 template <typename... Instructions>
 using Run = Start::template Run<Instructions...>;
@@ -564,6 +1299,92 @@ template <typename> struct Debug;
 template <typename... Instructions>
 static constexpr auto debug = _impl_::Debug<Run<Instructions...>>{};
 
+// Value-based counterpart of `Runtime`: the whole state is one structural
+// value with fixed-capacity storage, which instructions update in place
+// within a single constant evaluation instead of minting a type per step.
+template <unsigned nvars = 64, unsigned nitems = 1024,
+          unsigned nout = 1u << 16>
+struct Machine {
+  using Datum = value::Datum<nitems>;
+
+  unsigned long long keys[nvars]{};
+  Datum vars[nvars]{};
+  unsigned count = 0;
+  unsigned cursor = 0;
+  char out[nout]{};
+  unsigned size = 0;
+
+  // Variables are keyed by `tfunc::_impl_::hash`, which identifies keys
+  // comparing equal across integral and enum types, as `GetItem` does.
+  template <auto var> constexpr unsigned slot() const noexcept {
+    for (unsigned i = 0; i < count; ++i)
+      if (keys[i] == tfunc::_impl_::hash<var>)
+        return i;
+    return count;
+  }
+
+  template <auto var> constexpr Datum get() const noexcept {
+    auto const i = slot<var>();
+    if (i == count)
+      value::fault("read of an unset variable");
+    return vars[i];
+  }
+
+  template <auto var> constexpr void set(Datum const &datum) noexcept {
+    auto const i = slot<var>();
+    if (i == count) {
+      if (count == nvars)
+        value::fault("too many variables for the machine");
+      keys[count++] = tfunc::_impl_::hash<var>;
+    }
+    vars[i] = datum;
+  }
+
+  template <auto var> constexpr void unset() noexcept {
+    auto const i = slot<var>();
+    if (i == count)
+      return;
+    keys[i] = keys[--count];
+    vars[i] = vars[count];
+  }
+
+  constexpr Datum peek(Datum const &offset) const noexcept {
+    auto const i = cursor + static_cast<unsigned>(offset.scalar());
+    if (i >= input.size)
+      return {};
+    return Datum::of(input[i]);
+  }
+
+  constexpr void advance(Datum const &offset) noexcept {
+    auto const n = static_cast<unsigned>(offset.scalar());
+    cursor = cursor + n < input.size ? cursor + n : input.size;
+  }
+
+  constexpr void put(Datum const &datum) noexcept {
+    if (size == nout)
+      value::fault("stdout does not fit in the machine");
+    out[size++] = static_cast<char>(datum.scalar());
+  }
+};
+
+namespace _impl_ {
+
+template <typename... Instructions> struct Evaluate {
+  static constexpr auto machine = [] {
+    Machine<> machine{};
+    exec::Block<Instructions...>::run(machine);
+    return machine;
+  }();
+
+  static constexpr auto result =
+      string::StringLiteral<machine.size>(machine.out);
+};
+
+} // namespace _impl_
+
+template <typename... Instructions>
+static constexpr auto evaluate = _impl_::Evaluate<Instructions...>::result;
+
 } // namespace runtime
 
 } // namespace detail
@@ -8,6 +8,10 @@
 #define GIL_STD_BASE_HPP_
 
 #include "std.impl.hpp"
+#include "std.native.hpp"
+#include "std.opt.hpp"
+#include "std.tier.hpp"
+#include "std.vm.hpp"
 
 namespace gil {
 namespace std {
@@ -87,7 +91,7 @@ static constexpr auto for_(auto init, auto cond, auto post) noexcept {
 
 namespace _impl_ {
 
-static constexpr struct : local {
+static constexpr struct : local, lib::opt::Scratch {
 } switcher;
 
 template <typename Expr, typename Body> struct Case {
@@ -141,7 +145,7 @@ static constexpr auto none_ = lib::ir::IR{lib::none::None{}};
 
 namespace _impl_ {
 
-static constexpr struct : local {
+static constexpr struct : local, lib::opt::Scratch {
 } _lambda_return_;
 
 template <typename Args, typename Body> struct Lambda {
@@ -155,41 +159,73 @@ template <typename Args, typename Body> struct Lambda {
         lib::bundle::fold([](auto arg, auto var) { return var_(arg) = var; },
                           args, varbundle),
         global_(_lambda_return_) = body, --global_(_stack_local_scope_),
-        break_(*global_(_lambda_return_)))};
+        break_(lib::ir::IR{lib::code::Drop{_lambda_return_}}))};
   }
 };
 
 } // namespace _impl_
 
+// A lambda's body runs in a context of its own, so it is optimised on its own.
+template <typename Args, typename Body, _impl_::Lambda<Args, Body> lambda>
+struct lib::opt::Fold<lambda> {
+  static constexpr auto result = std::_impl_::Lambda{
+      lambda.args,
+      lib::opt::prune<lib::opt::share<lib::opt::fold<lambda.body>>>};
+};
+
 static constexpr auto fn_(auto... args) {
   return [=](auto... code) {
     return _impl_::Lambda{lib::bundle::Bundle{args...}, loop_(code..., break_)};
   };
 }
 
+enum class Engine {
+  // Instantiates one template per interpreter step.
+  Interpret,
+  // Lowers the program to bytecode and runs it in one constant evaluation.
+  VM,
+};
+
 namespace _impl_ {
 
 template <lib::bundle::Bundle code>
-using Main = lib::interpret::Interpret<detail::runtime::Start,
-                                       lib::bundle::Bundle{
-                                           global_(_stack_local_scope_) = 0,
-                                           code,
-                                       }>;
+static constexpr auto program =
+    lib::opt::prune<lib::opt::share<lib::opt::fold<lib::bundle::Bundle{
+        global_(_stack_local_scope_) = 0, code}>>>;
 
-} // namespace _impl_
+template <lib::bundle::Bundle code>
+using Main = lib::interpret::Interpret<detail::runtime::Start, program<code>>;
 
+template <lib::bundle::Bundle code, Engine> struct Run;
+
+template <lib::bundle::Bundle code> struct Run<code, Engine::Interpret> {
 #if DEBUG == 0
-template <lib::bundle::Bundle code>
-static constexpr auto main =
-    detail::string::as_literal<typename _impl_::Main<code>::Effect::Stdout>;
+  static constexpr auto result =
+      detail::string::as_literal<typename Main<code>::Effect::Stdout>;
 #else
-template <lib::bundle::Bundle code>
-static constexpr auto main =
-    detail::runtime::_impl_::Debug<typename _impl_::Main<code>
+  static constexpr auto result =
+      detail::runtime::_impl_::Debug<typename Main<code>
 #if DEBUG == 1
-                                   ::Effect
+                                     ::Effect
+#endif
+                                     >{};
 #endif
-                                   >{};
+};
+
+template <lib::bundle::Bundle code> struct Run<code, Engine::VM> {
+  static constexpr auto result = lib::vm::run<program<code>>;
+};
+
+} // namespace _impl_
+
+#ifdef __STDIN__
+template <lib::bundle::Bundle code, Engine engine = Engine::Interpret>
+static constexpr auto main = _impl_::Run<code, engine>::result;
+#else
+// Built as a normal executable, every engine defers to `lib::native`, which
+// runs the program on the real stdin when the executable starts.
+template <lib::bundle::Bundle code, Engine = Engine::Interpret>
+static auto const main = lib::native::install<_impl_::program<code>>();
 #endif
 
 } // namespace std
@@ -139,6 +139,11 @@ template <typename Ch> struct PutC {
   Ch ch;
 };
 
+// Reads a variable for the last time, removing it from the state.
+template <typename Name> struct Drop {
+  Name name;
+};
+
 template <typename Fn, typename... Args> struct Invoke {
   Fn fn;
   bundle::Bundle<Args...> args;
@@ -367,6 +372,15 @@ template <typename Code> struct IR {
 
 } // namespace ir
 
+namespace tier {
+
+// Loops that std.tier.hpp runs on the VM instead of step by step.
+template <auto loop> struct Promotes {
+  static constexpr bool value = false;
+};
+
+} // namespace tier
+
 namespace interpret {
 
 template <typename Runtime, auto code> struct Interpret {
@@ -408,6 +422,17 @@ template <typename Runtime, code::Ref ref> struct Interpret<Runtime, ref> {
   static constexpr auto retval = code::Ref{InterpretName::retval};
 };
 
+template <typename Runtime, code::Drop drop> struct Interpret<Runtime, drop> {
+  using InterpretName = Interpret<Runtime, drop.name>;
+
+  static constexpr auto retval =
+      detail::tfunc::GetItem<typename InterpretName::Effect::State,
+                             InterpretName::retval,
+                             detail::type::Value<none::None{}>>::value;
+  using Effect = InterpretName::Effect::template Run<
+      detail::exec::Unset<InterpretName::retval>>;
+};
+
 template <typename Runtime, code::Assign assign>
 struct Interpret<Runtime, assign> {
   using InterpretVar = Interpret<Runtime, assign.var>;
@@ -583,8 +608,8 @@ template <typename Runtime, code::Peek peek> struct Interpret<Runtime, peek> {
 
   using Effect = InterpretOffset::Effect;
   static constexpr auto retval =
-      ir::value<detail::tfunc::Get<typename InterpretOffset::Effect::Stdin,
-                                   InterpretOffset::retval, none::None>>;
+      ir::value<typename InterpretOffset::Effect::template Peek<
+          InterpretOffset::retval, none::None>>;
 };
 
 template <typename Runtime, code::Advance advance>
@@ -599,7 +624,7 @@ struct Interpret<Runtime, advance> {
 template <typename Runtime, code::GetC getc> struct Interpret<Runtime, getc> {
   using Effect = Runtime::template Run<detail::exec::Advance<>>;
   static constexpr auto retval =
-      ir::value<detail::tfunc::Get<typename Runtime::Stdin, 0, none::None>>;
+      ir::value<typename Runtime::template Peek<0, none::None>>;
 };
 
 template <typename Runtime, code::PutC putc> struct Interpret<Runtime, putc> {
@@ -618,42 +643,73 @@ struct Interpret<Runtime, block> {
 
 namespace _impl_ {
 
-template <auto prev, auto next> struct BlockPhase {};
+// Runs statements [lo, hi) of `block` after a statement that returned `prev`.
+// Ranges are halved rather than peeled, so that a block of n statements only
+// nests O(log n) instantiations deep and never copies its remaining code.
+template <unsigned lo, unsigned hi, auto prev, auto block> struct BlockRange {};
+
+template <auto result> struct BlockResult {};
 
 } // namespace _impl_
 
 template <typename Runtime, typename Head, typename... Code,
           code::ctrl::Block<Head, Code...> block>
 struct Interpret<Runtime, block> {
-  using InterpretHead = Interpret<Runtime, block.code.head>;
-  using InterpretTail =
-      Interpret<typename InterpretHead::Effect,
-                _impl_::BlockPhase<InterpretHead::retval,
-                                   code::ctrl::Block{block.code.tail}>{}>;
+  using InterpretRange =
+      Interpret<Runtime, _impl_::BlockRange<0, 1 + sizeof...(Code),
+                                            none::None{}, block>{}>;
+  using InterpretResult =
+      Interpret<typename InterpretRange::Effect,
+                _impl_::BlockResult<InterpretRange::retval>{}>;
 
-  using Effect = InterpretTail::Effect;
-  static constexpr auto retval = InterpretTail::retval;
+  using Effect = InterpretResult::Effect;
+  static constexpr auto retval = InterpretResult::retval;
 };
 
-template <typename Runtime, auto prev, auto next,
-          _impl_::BlockPhase<prev, next> phase>
-  requires(!requires { code::ctrl::_impl_::Flow<prev>{}; })
-struct Interpret<Runtime, phase> {
-  using InterpretNext = Interpret<Runtime, next>;
+template <typename Runtime, unsigned lo, unsigned hi, auto prev, auto block,
+          _impl_::BlockRange<lo, hi, prev, block> range>
+  requires requires { code::ctrl::_impl_::Flow<prev>{}; }
+struct Interpret<Runtime, range> {
+  using Effect = Runtime;
+  static constexpr auto retval = prev;
+};
 
-  using Effect = InterpretNext::Effect;
-  static constexpr auto retval = InterpretNext::retval;
+template <typename Runtime, unsigned lo, unsigned hi, auto prev, auto block,
+          _impl_::BlockRange<lo, hi, prev, block> range>
+  requires(hi == lo + 1 && !requires { code::ctrl::_impl_::Flow<prev>{}; })
+struct Interpret<Runtime, range> {
+  using InterpretStatement =
+      Interpret<Runtime, block.code.template get<lo>()>;
+
+  using Effect = InterpretStatement::Effect;
+  static constexpr auto retval = InterpretStatement::retval;
 };
 
-template <typename Runtime, code::ctrl::Continue continue_, auto next,
-          _impl_::BlockPhase<continue_, next> phase>
+template <typename Runtime, unsigned lo, unsigned hi, auto prev, auto block,
+          _impl_::BlockRange<lo, hi, prev, block> range>
+  requires(hi > lo + 1 && !requires { code::ctrl::_impl_::Flow<prev>{}; })
+struct Interpret<Runtime, range> {
+  static constexpr unsigned mid = lo + (hi - lo) / 2;
+
+  using InterpretFirst =
+      Interpret<Runtime, _impl_::BlockRange<lo, mid, prev, block>{}>;
+  using InterpretSecond =
+      Interpret<typename InterpretFirst::Effect,
+                _impl_::BlockRange<mid, hi, InterpretFirst::retval, block>{}>;
+
+  using Effect = InterpretSecond::Effect;
+  static constexpr auto retval = InterpretSecond::retval;
+};
+
+template <typename Runtime, auto result, _impl_::BlockResult<result> phase>
+  requires(!requires { code::ctrl::_impl_::IsBreak<result>{}; })
 struct Interpret<Runtime, phase> {
   using Effect = Runtime;
-  static constexpr auto retval = continue_;
+  static constexpr auto retval = result;
 };
 
-template <typename Runtime, typename T, code::ctrl::Break<T> break_, auto next,
-          _impl_::BlockPhase<break_, next> phase>
+template <typename Runtime, typename T, code::ctrl::Break<T> break_,
+          _impl_::BlockResult<break_> phase>
 struct Interpret<Runtime, phase> {
   using InterpretBreak = Interpret<Runtime, break_.result>;
 
@@ -665,7 +721,12 @@ namespace _impl_ {
 
 template <bool, auto iftrue, auto iffalse> struct Branch {};
 
-template <auto prev_iter, auto loop> struct Loop {};
+// Runs at most 2^k iterations of `loop` after an iteration that returned
+// `prev_iter`. `Loop` drives batches of doubling size, so that a loop of n
+// iterations only nests O(log n) instantiations deep.
+template <unsigned k, auto prev_iter, auto loop> struct Iterate {};
+
+template <unsigned k, auto prev_iter, auto loop> struct Loop {};
 
 } // namespace _impl_
 
@@ -700,16 +761,48 @@ struct Interpret<Runtime, branch> {
 };
 
 template <typename Runtime, typename Code, code::ctrl::LoopBlock<Code> loop>
+  requires(!tier::Promotes<loop>::value)
 struct Interpret<Runtime, loop> {
   using InterpretLoop =
-      Interpret<Runtime, _impl_::Loop<code::ctrl::Continue{}, loop.code>{}>;
+      Interpret<Runtime, _impl_::Loop<0, code::ctrl::Continue{}, loop.code>{}>;
 
   using Effect = InterpretLoop::Effect;
   static constexpr auto retval = InterpretLoop::retval;
 };
 
-template <typename Runtime, typename T, code::ctrl::Break<T> break_, auto code,
-          _impl_::Loop<break_, code> loop>
+template <typename Runtime, unsigned k, typename T, code::ctrl::Break<T> break_,
+          auto code, _impl_::Iterate<k, break_, code> iterate>
+struct Interpret<Runtime, iterate> {
+  using Effect = Runtime;
+  static constexpr auto retval = break_;
+};
+
+template <typename Runtime, auto prev_iter, auto code,
+          _impl_::Iterate<0, prev_iter, code> iterate>
+  requires(!requires { code::ctrl::_impl_::IsBreak<prev_iter>{}; })
+struct Interpret<Runtime, iterate> {
+  using InterpretOnce = Interpret<Runtime, code>;
+
+  using Effect = InterpretOnce::Effect;
+  static constexpr auto retval = InterpretOnce::retval;
+};
+
+template <typename Runtime, unsigned k, auto prev_iter, auto code,
+          _impl_::Iterate<k, prev_iter, code> iterate>
+  requires(k > 0 && !requires { code::ctrl::_impl_::IsBreak<prev_iter>{}; })
+struct Interpret<Runtime, iterate> {
+  using InterpretFirst =
+      Interpret<Runtime, _impl_::Iterate<k - 1, prev_iter, code>{}>;
+  using InterpretSecond =
+      Interpret<typename InterpretFirst::Effect,
+                _impl_::Iterate<k - 1, InterpretFirst::retval, code>{}>;
+
+  using Effect = InterpretSecond::Effect;
+  static constexpr auto retval = InterpretSecond::retval;
+};
+
+template <typename Runtime, unsigned k, typename T, code::ctrl::Break<T> break_,
+          auto code, _impl_::Loop<k, break_, code> loop>
 struct Interpret<Runtime, loop> {
   using InterpretBreak = Interpret<Runtime, break_.result>;
 
@@ -717,13 +810,15 @@ struct Interpret<Runtime, loop> {
   static constexpr auto retval = InterpretBreak::retval;
 };
 
-template <typename Runtime, auto prev_iter, auto code,
-          _impl_::Loop<prev_iter, code> loop>
+template <typename Runtime, unsigned k, auto prev_iter, auto code,
+          _impl_::Loop<k, prev_iter, code> loop>
   requires(!requires { code::ctrl::_impl_::IsBreak<prev_iter>{}; })
 struct Interpret<Runtime, loop> {
-  using InterpretOnce = Interpret<Runtime, code>;
-  using InterpretLoop = Interpret<typename InterpretOnce::Effect,
-                                  _impl_::Loop<InterpretOnce::retval, code>{}>;
+  using InterpretBatch =
+      Interpret<Runtime, _impl_::Iterate<k, prev_iter, code>{}>;
+  using InterpretLoop =
+      Interpret<typename InterpretBatch::Effect,
+                _impl_::Loop<k + 1, InterpretBatch::retval, code>{}>;
 
   using Effect = InterpretLoop::Effect;
   static constexpr auto retval = InterpretLoop::retval;
@@ -16,11 +16,11 @@ namespace io {
 
 namespace _impl_ {
 
-constexpr struct : local {
+constexpr struct : local, lib::opt::Scratch {
 } _io_idx_;
 static constexpr auto idx = global_(_io_idx_);
 
-constexpr struct : local {
+constexpr struct : local, lib::opt::Scratch {
 } _io_tmp_;
 static constexpr auto tmp = global_(_io_tmp_);
 
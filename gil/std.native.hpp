@@ -0,0 +1,65 @@
+/** ********
+ * GIL Standard Library - Native Execution
+ *
+ * This header runs programs when the executable does, for builds that skip
+ * the abstract system emulator driver.
+ */
+
+#ifndef GIL_STD_NATIVE_HPP_
+#define GIL_STD_NATIVE_HPP_
+
+#ifndef __STDIN__
+
+#include <stdio.h>
+
+#include "std.vm.hpp"
+
+namespace gil {
+namespace std {
+
+namespace lib {
+
+namespace native {
+
+// The program installed by `std::main`.
+inline int (*entry)() = nullptr;
+
+// Runs the program's bytecode over the real stdin, then writes everything it
+// printed, so that output matches a compile-time run on the same input.
+template <auto code> int run() {
+  vm::Buffer<char> input;
+  for (;;) {
+    if (input.size == input.capacity)
+      input.reserve(input.capacity ? 2 * input.capacity : 1u << 12);
+    auto const n =
+        fread(input.data + input.size, 1, input.capacity - input.size, stdin);
+    if (n == 0)
+      break;
+    input.size += n;
+  }
+
+  vm::Machine machine{input.data, input.size};
+  machine.run(vm::compile<code>);
+  fwrite(machine.out.data, 1, machine.out.size, stdout);
+  return 0;
+}
+
+template <auto code> int (*install())() { return entry = &run<code>; }
+
+// The executable's entry point. It is only named `main` by its symbol, since
+// the name itself belongs to `std::main`, and is weak so that including this
+// header in several translation units still links.
+[[gnu::weak]] int start() __asm__("main");
+
+int start() { return entry ? entry() : 0; }
+
+} // namespace native
+
+} // namespace lib
+
+} // namespace std
+} // namespace gil
+
+#endif
+
+#endif // GIL_STD_NATIVE_HPP_
@@ -0,0 +1,1759 @@
+/** ********
+ * GIL Standard Library - Optimisation
+ *
+ * This header rewrites programs before they are run, so that the interpreter
+ * has fewer steps to take, and less state to carry.
+ */
+
+#ifndef GIL_STD_OPT_HPP_
+#define GIL_STD_OPT_HPP_
+
+#include "std.impl.hpp"
+#include "std.vm.hpp"
+
+namespace gil {
+namespace std {
+
+namespace lib {
+
+namespace opt {
+
+// Base of the names of library temporaries, like those of `io`. Their values
+// never outlive the construct that sets them, and they are never referenced,
+// so they can be forgotten as soon as they are dead.
+struct Scratch {};
+
+namespace _impl_ {
+
+// Values the interpreter passes through untouched, and that operators only
+// ever see as themselves.
+template <typename T> constexpr bool constant(T const &) noexcept {
+  return !__is_class(T);
+}
+
+constexpr bool constant(none::None const &) noexcept { return true; }
+
+// Scratch names, and their subscripts by constants.
+template <typename T> constexpr bool scratch(T const &) noexcept {
+  return __is_base_of(Scratch, T);
+}
+
+template <typename T, typename... Ts>
+constexpr bool scratch(bundle::Bundle<T, Ts...> const &name) noexcept {
+  return scratch(name.head) && (!__is_class(Ts) && ...);
+}
+
+// The pure operators, applied to constants. An operator only folds when its
+// result is a constant expression, so that e.g. a division by zero is still
+// reported where (and if) it runs.
+template <detail::string::StringLiteral, auto...> struct Evaluate;
+
+#define PURE_UN_OP(O)                                                          \
+  template <auto arg>                                                          \
+    requires requires { detail::tfunc::_impl_::Box<(O arg)>{}; }               \
+  struct Evaluate<#O "#", arg> {                                               \
+    static constexpr auto result = O arg;                                      \
+  };
+#define PURE_BIN_OP(O)                                                         \
+  template <auto lhs, auto rhs>                                                \
+    requires requires { detail::tfunc::_impl_::Box<(lhs O rhs)>{}; }           \
+  struct Evaluate<#O, lhs, rhs> {                                              \
+    static constexpr auto result = lhs O rhs;                                  \
+  };
+#include "ops.inc"
+
+// Spelled out, since deduction would unwrap a bundle or IR holding another.
+template <typename... Ts>
+constexpr auto bundle_of(Ts const &...items) noexcept {
+  return bundle::Bundle<Ts...>{items...};
+}
+
+template <typename Code> constexpr auto ir_of(Code const &code) noexcept {
+  return ir::IR<Code>{code};
+}
+
+template <detail::string::StringLiteral name, typename... Args>
+constexpr auto operator_of(bundle::Bundle<Args...> const &args) noexcept {
+  return code::Operator<name, Args...>{args};
+}
+
+template <typename To, typename From>
+constexpr auto cast_of(From const &from) noexcept {
+  return code::Cast<To, From>{from};
+}
+
+template <typename T> constexpr auto break_of(T const &result) noexcept {
+  return code::ctrl::Break<T>{result};
+}
+
+template <typename Cond, typename IfTrue, typename IfFalse>
+constexpr auto if_of(Cond const &cond, IfTrue const &iftrue,
+                     IfFalse const &iffalse) noexcept {
+  return code::ctrl::IfBlock<Cond, IfTrue, IfFalse>{cond, iftrue, iffalse};
+}
+
+template <typename Cond, typename IfTrue>
+constexpr auto if_of(Cond const &cond, IfTrue const &iftrue) noexcept {
+  return code::ctrl::IfBlock<Cond, IfTrue, void>{cond, iftrue};
+}
+
+template <typename... Code>
+constexpr auto block_of(bundle::Bundle<Code...> const &code) noexcept {
+  return code::ctrl::Block<Code...>{code};
+}
+
+} // namespace _impl_
+
+// Folds operators and casts whose operands are all constants into their
+// results, throughout the code.
+template <auto code> struct Fold {
+  static constexpr auto result = code;
+};
+
+template <auto code> static constexpr auto fold = Fold<code>::result;
+
+template <typename... Code, bundle::Bundle<Code...> bundle>
+  requires(sizeof...(Code) > 0)
+struct Fold<bundle> {
+  template <unsigned... is>
+  static constexpr auto apply(detail::tfunc::_impl_::Indices<is...>) {
+    return _impl_::bundle_of(fold<bundle.template get<is>()>...);
+  }
+
+  static constexpr auto result =
+      apply(detail::tfunc::_impl_::MakeIndices<sizeof...(Code)>{});
+};
+
+template <typename Code, ir::IR<Code> ir> struct Fold<ir> {
+  static constexpr auto result = _impl_::ir_of(fold<ir.code>);
+};
+
+template <typename Name, code::Var<Name> var> struct Fold<var> {
+  static constexpr auto result = code::Var{fold<var.name>};
+};
+
+template <typename Var, typename Expr, code::Assign<Var, Expr> assign>
+struct Fold<assign> {
+  static constexpr auto result =
+      code::Assign{fold<assign.var>, fold<assign.expr>};
+};
+
+// A subscript of a scratch name by constants is a name itself, as
+// `BoundVar::operator[]` would make it.
+template <detail::string::StringLiteral name, auto args> struct Subscript {};
+
+template <typename Name, typename... Ts,
+          bundle::Bundle<code::Var<Name>, Ts...> args>
+  requires(_impl_::scratch(bundle::Bundle<Name, Ts...>{args.head.name,
+                                                         args.tail}))
+struct Subscript<"[]", args> {
+  static constexpr auto result =
+      code::Var{bundle::Bundle<Name, Ts...>{args.head.name, args.tail}};
+};
+
+template <detail::string::StringLiteral name, typename... Args,
+          code::Operator<name, Args...> op>
+struct Fold<op> {
+  static constexpr auto args = fold<op.args>;
+
+  template <unsigned... is>
+  static constexpr auto apply(detail::tfunc::_impl_::Indices<is...>) {
+    if constexpr (requires { Subscript<name, args>::result; })
+      return Subscript<name, args>::result;
+    else if constexpr ((_impl_::constant(args.template get<is>()) && ...) &&
+                  requires {
+                    _impl_::Evaluate<name, args.template get<is>()...>::result;
+                  })
+      return _impl_::Evaluate<name, args.template get<is>()...>::result;
+    else
+      return _impl_::operator_of<name>(args);
+  }
+
+  static constexpr auto result =
+      apply(detail::tfunc::_impl_::MakeIndices<sizeof...(Args)>{});
+};
+
+template <typename To, typename From, code::Cast<To, From> cast>
+struct Fold<cast> {
+  static constexpr auto from = fold<cast.from>;
+
+  static constexpr auto result = [] {
+    if constexpr (_impl_::constant(from))
+      return static_cast<To>(from);
+    else
+      return _impl_::cast_of<To>(from);
+  }();
+};
+
+template <typename Offset, code::Peek<Offset> peek> struct Fold<peek> {
+  static constexpr auto result = code::Peek{fold<peek.offset>};
+};
+
+template <typename Offset, code::Advance<Offset> advance>
+struct Fold<advance> {
+  static constexpr auto result = code::Advance{fold<advance.offset>};
+};
+
+template <typename Ch, code::PutC<Ch> putc> struct Fold<putc> {
+  static constexpr auto result = code::PutC{fold<putc.ch>};
+};
+
+template <typename T, code::ctrl::Break<T> break_> struct Fold<break_> {
+  static constexpr auto result = _impl_::break_of(fold<break_.result>);
+};
+
+template <typename... Code, code::ctrl::Block<Code...> block>
+struct Fold<block> {
+  static constexpr auto result = _impl_::block_of(fold<block.code>);
+};
+
+template <typename Cond, typename IfTrue, typename IfFalse,
+          code::ctrl::IfBlock<Cond, IfTrue, IfFalse> if_>
+struct Fold<if_> {
+  static constexpr auto result = [] {
+    if constexpr (__is_same(IfFalse, void))
+      return _impl_::if_of(fold<if_.cond>, fold<if_.iftrue>);
+    else
+      return _impl_::if_of(fold<if_.cond>, fold<if_.iftrue>,
+                           fold<if_.iffalse>);
+  }();
+};
+
+template <typename Code, code::ctrl::LoopBlock<Code> loop> struct Fold<loop> {
+  static constexpr auto result = code::ctrl::LoopBlock{fold<loop.code>};
+};
+
+namespace _impl_ {
+
+// A scratch key, by its hash as a state key. A family stands for every
+// subscript of `root`, for subscripts by values only known when run.
+struct Key {
+  unsigned long long hash = 0;
+  unsigned long long root = 0;
+  bool family = false;
+
+  constexpr bool covers(Key const &key) const noexcept {
+    if (family)
+      return key.hash != key.root && key.root == root;
+    return !key.family && key.hash == hash;
+  }
+};
+
+template <auto name> constexpr Key key_of() noexcept {
+  if constexpr (requires { name.head; })
+    return {detail::tfunc::_impl_::hash<name>,
+            detail::tfunc::_impl_::hash<name.head>};
+  else
+    return {detail::tfunc::_impl_::hash<name>,
+            detail::tfunc::_impl_::hash<name>};
+}
+
+template <auto name> constexpr Key family_of() noexcept {
+  return {detail::tfunc::_impl_::hash<name>, detail::tfunc::_impl_::hash<name>,
+          true};
+}
+
+// A set of scratch keys. One that overflows holds every key, which is only
+// ever more conservative.
+struct Keys {
+  static constexpr unsigned capacity = 16;
+
+  Key keys[capacity]{};
+  unsigned size = 0;
+  bool all = false;
+
+  constexpr bool has(Key const &key) const noexcept {
+    if (all)
+      return true;
+    for (unsigned i = 0; i < size; ++i)
+      if (keys[i].covers(key))
+        return true;
+    return false;
+  }
+
+  constexpr bool holds(Key const &key) const noexcept {
+    for (unsigned i = 0; i < size; ++i)
+      if (keys[i].hash == key.hash && keys[i].family == key.family)
+        return true;
+    return false;
+  }
+
+  constexpr void add(Key const &key) noexcept {
+    if (all || holds(key))
+      return;
+    if (size == capacity)
+      all = true;
+    else
+      keys[size++] = key;
+  }
+
+  constexpr void remove(Key const &key) noexcept {
+    for (unsigned i = 0; i < size; ++i)
+      if (!keys[i].family && keys[i].hash == key.hash) {
+        keys[i] = keys[--size];
+        return;
+      }
+  }
+
+  constexpr void merge(Keys const &other) noexcept {
+    all = all || other.all;
+    for (unsigned i = 0; i < other.size; ++i)
+      add(other.keys[i]);
+  }
+};
+
+// Where control goes on `break_` and `continue_`, by what is live there.
+struct Flow {
+  Keys breaks;
+  Keys continues;
+};
+
+// The keys in both sets, for stores made on every way somewhere.
+constexpr Keys both(Keys const &lhs, Keys const &rhs) noexcept {
+  Keys keys{};
+  for (unsigned i = 0; i < lhs.size; ++i)
+    if (rhs.holds(lhs.keys[i]))
+      keys.add(lhs.keys[i]);
+  return keys;
+}
+
+// The keys in either set, for stores. Those that do not fit are left out,
+// which is only ever more conservative.
+constexpr Keys either(Keys lhs, Keys const &rhs) noexcept {
+  for (unsigned i = 0; i < rhs.size && lhs.size < Keys::capacity; ++i)
+    lhs.add(rhs.keys[i]);
+  return lhs;
+}
+
+constexpr Keys except(Keys keys, Keys const &stores) noexcept {
+  for (unsigned i = 0; i < stores.size; ++i)
+    keys.remove(stores.keys[i]);
+  return keys;
+}
+
+// A way out of some code: falling through, `break_` or `continue_`.
+struct Exit {
+  bool reached = false;
+  // Keys stored to on every way there.
+  Keys stores;
+};
+
+enum Way : unsigned { next, breaks, continues, ways };
+
+constexpr Exit join(Exit const &lhs, Exit const &rhs) noexcept {
+  if (!lhs.reached)
+    return rhs;
+  if (!rhs.reached)
+    return lhs;
+  return {true, both(lhs.stores, rhs.stores)};
+}
+
+// Liveness across some code, independent of what is live after it: the keys
+// it reads before storing to them, and for each way out, those it stores to
+// on the way. Being distributive, this is exact.
+struct Summary {
+  Keys reads;
+  Exit exits[ways];
+
+  constexpr Keys in(Keys const &out, Flow const &flow) const noexcept {
+    Keys const *const targets[ways] = {&out, &flow.breaks, &flow.continues};
+    auto in = reads;
+    for (unsigned way = 0; way < ways; ++way)
+      if (exits[way].reached)
+        in.merge(except(*targets[way], exits[way].stores));
+    return in;
+  }
+};
+
+constexpr Summary pass() noexcept {
+  Summary summary{};
+  summary.exits[next].reached = true;
+  return summary;
+}
+
+constexpr Summary opaque() noexcept {
+  auto summary = pass();
+  summary.reads.all = true;
+  return summary;
+}
+
+constexpr Summary read(Key const &key) noexcept {
+  auto summary = pass();
+  summary.reads.add(key);
+  return summary;
+}
+
+constexpr Summary store(Key const &key) noexcept {
+  auto summary = pass();
+  summary.exits[next].stores.add(key);
+  return summary;
+}
+
+constexpr Summary then(Summary const &first, Summary const &second) noexcept {
+  auto const &on = first.exits[next];
+  Summary summary{};
+  summary.reads = first.reads;
+  if (on.reached)
+    summary.reads.merge(except(second.reads, on.stores));
+  for (unsigned way = 0; way < ways; ++way) {
+    Exit through{};
+    if (on.reached && second.exits[way].reached)
+      through = {true, either(on.stores, second.exits[way].stores)};
+    summary.exits[way] =
+        way == next ? through : join(first.exits[way], through);
+  }
+  return summary;
+}
+
+constexpr Summary branch(Summary const &cond, Summary const &iftrue,
+                         Summary const &iffalse) noexcept {
+  Summary arms{};
+  arms.reads = iftrue.reads;
+  arms.reads.merge(iffalse.reads);
+  for (unsigned way = 0; way < ways; ++way)
+    arms.exits[way] = join(iftrue.exits[way], iffalse.exits[way]);
+  return then(cond, arms);
+}
+
+constexpr Summary jump(Summary summary, Way way) noexcept {
+  summary.exits[way] = summary.exits[next];
+  summary.exits[next] = {};
+  return summary;
+}
+
+// Later iterations only read what the first one does, or stored to before,
+// so the loop's summary needs no fixpoint.
+constexpr Summary loop(Summary const &body) noexcept {
+  Summary summary{};
+  summary.reads = body.reads;
+  summary.exits[next] = body.exits[breaks];
+  return summary;
+}
+
+// The scratch names some code mentions, without repeats.
+template <auto... names> struct Names {};
+
+template <typename Names, typename... More> struct Merge {
+  using Result = Names;
+};
+
+template <auto... as, auto b, auto... bs, typename... More>
+struct Merge<Names<as...>, Names<b, bs...>, More...> {
+  using Result =
+      Merge<typename detail::tfunc::_impl_::Select<
+                ((detail::tfunc::_impl_::hash<as> ==
+                  detail::tfunc::_impl_::hash<b>) ||
+                 ...),
+                Names<as...>, Names<as..., b>>::Result,
+            Names<bs...>, More...>::Result;
+};
+
+template <auto... as, typename... More>
+struct Merge<Names<as...>, Names<>, More...> {
+  using Result = Merge<Names<as...>, More...>::Result;
+};
+
+template <auto... names> constexpr Keys keys_of(Names<names...>) noexcept {
+  Keys keys{};
+  (keys.add(key_of<names>()), ...);
+  return keys;
+}
+
+// Code that touches no variables: literals, and lambdas, whose bodies run in
+// their own context.
+template <typename T> constexpr bool inert(T const &) noexcept {
+  return !__is_class(T) || __is_empty(T) ||
+         requires(T const &code) {
+           code.args;
+           code.body;
+         };
+}
+
+template <unsigned n>
+constexpr bool inert(detail::string::StringLiteral<n> const &) noexcept {
+  return true;
+}
+
+// Whether code of some type may mention scratch names or jump, and so needs
+// looking into. Decided by type, so it is shared by all code alike.
+template <typename T> struct Touches {
+  static constexpr bool value = __is_base_of(Scratch, T);
+};
+
+template <typename T> struct Touches<T const> : Touches<T> {};
+
+template <template <typename...> typename C, typename... Ts>
+struct Touches<C<Ts...>> {
+  static constexpr bool value = (Touches<Ts>::value || ...);
+};
+
+template <detail::string::StringLiteral name, typename... Args>
+struct Touches<code::Operator<name, Args...>> {
+  static constexpr bool value = (Touches<Args>::value || ...);
+};
+
+template <typename T> struct Touches<code::ctrl::Break<T>> {
+  static constexpr bool value = true;
+};
+
+template <> struct Touches<code::ctrl::Continue> {
+  static constexpr bool value = true;
+};
+
+struct Untouched {
+  using Mentions = Names<>;
+
+  static constexpr auto summary = pass();
+};
+
+} // namespace _impl_
+
+// Liveness of scratch keys, as a summary of the code computed once.
+template <auto code> struct Flows {
+  using Mentions = _impl_::Names<>;
+
+  static constexpr auto summary =
+      _impl_::inert(code) ? _impl_::pass() : _impl_::opaque();
+};
+
+// Code that cannot touch scratch names lets liveness through as it is.
+template <auto code>
+struct Live
+    : detail::tfunc::_impl_::Select<_impl_::Touches<decltype(code)>::value,
+                                    Flows<code>, _impl_::Untouched>::Result {};
+
+template <typename T, typename... Ts, bundle::Bundle<T, Ts...> bundle>
+struct Flows<bundle> {
+  using Mentions =
+      _impl_::Merge<typename Live<bundle.head>::Mentions,
+                    typename Live<bundle.tail>::Mentions>::Result;
+
+  static constexpr auto summary =
+      _impl_::then(Live<bundle.head>::summary, Live<bundle.tail>::summary);
+};
+
+template <typename Code, ir::IR<Code> ir> struct Flows<ir> : Live<ir.code> {};
+
+template <typename Name, code::Var<Name> var> struct Flows<var> {
+  static constexpr bool named = _impl_::scratch(var.name);
+
+  using Mentions = detail::tfunc::_impl_::Select<
+      named, _impl_::Names<var.name>,
+      typename Live<var.name>::Mentions>::Result;
+
+  static constexpr auto summary = [] {
+    if constexpr (named)
+      return _impl_::read(_impl_::key_of<var.name>());
+    else
+      return Live<var.name>::summary;
+  }();
+};
+
+template <typename Name, code::Ref<Name> ref>
+struct Flows<ref> : Live<code::Var<Name>{ref.name}> {};
+
+template <typename Name, code::Drop<Name> drop>
+struct Flows<drop> : Live<code::Var<Name>{drop.name}> {};
+
+// A store to a scratch name ends its liveness.
+template <auto args> struct Store : Live<args> {};
+
+template <typename Name, typename Expr,
+          bundle::Bundle<code::Var<Name>, Expr> args>
+  requires(_impl_::scratch(args.head.name))
+struct Store<args> {
+  static constexpr auto var = args.head;
+  static constexpr auto expr = args.tail.head;
+
+  using Mentions = _impl_::Merge<_impl_::Names<var.name>,
+                                 typename Live<expr>::Mentions>::Result;
+
+  static constexpr bool dead(_impl_::Keys const &out) noexcept {
+    return !out.has(_impl_::key_of<var.name>());
+  }
+
+  static constexpr auto summary = _impl_::then(
+      Live<expr>::summary, _impl_::store(_impl_::key_of<var.name>()));
+};
+
+template <detail::string::StringLiteral name, auto args>
+struct Operate : Live<args> {};
+
+template <auto args> struct Operate<"=", args> : Store<args> {};
+
+template <auto args> struct Operate<"&&", args> : Live<args> {
+  static constexpr auto summary =
+      _impl_::branch(Live<args.head>::summary, Live<args.tail.head>::summary,
+                     _impl_::pass());
+};
+
+template <auto args> struct Operate<"||", args> : Operate<"&&", args> {};
+
+// Subscripts left by folding are by values only known when run, and may read
+// any subscript of the name.
+template <auto args> struct Operate<"[]", args> : Live<args> {
+  static constexpr auto summary = [] {
+    if constexpr (requires { _impl_::scratch(args.head.name); }) {
+      if constexpr (_impl_::scratch(args.head.name))
+        return _impl_::then(Live<args>::summary,
+                            _impl_::read(_impl_::family_of<args.head.name>()));
+      else
+        return Live<args>::summary;
+    } else {
+      return Live<args>::summary;
+    }
+  }();
+};
+
+template <detail::string::StringLiteral name, typename... Args,
+          code::Operator<name, Args...> op>
+struct Flows<op> : Operate<name, op.args> {};
+
+template <typename Var, typename Expr, code::Assign<Var, Expr> assign>
+struct Flows<assign> : Store<_impl_::bundle_of(assign.var, assign.expr)> {};
+
+template <typename To, typename From, code::Cast<To, From> cast>
+struct Flows<cast> : Live<cast.from> {};
+
+template <typename Offset, code::Peek<Offset> peek>
+struct Flows<peek> : Live<peek.offset> {};
+
+template <typename Offset, code::Advance<Offset> advance>
+struct Flows<advance> : Live<advance.offset> {};
+
+template <typename Ch, code::PutC<Ch> putc>
+struct Flows<putc> : Live<putc.ch> {};
+
+template <typename T, code::ctrl::Break<T> break_> struct Flows<break_> {
+  using Mentions = Live<break_.result>::Mentions;
+
+  static constexpr auto summary =
+      _impl_::jump(Live<break_.result>::summary, _impl_::breaks);
+};
+
+template <code::ctrl::Continue continue_> struct Flows<continue_> {
+  using Mentions = _impl_::Names<>;
+
+  static constexpr auto summary =
+      _impl_::jump(_impl_::pass(), _impl_::continues);
+};
+
+template <typename... Code, code::ctrl::Block<Code...> block>
+struct Flows<block> : Live<block.code> {};
+
+template <typename Cond, typename IfTrue, typename IfFalse,
+          code::ctrl::IfBlock<Cond, IfTrue, IfFalse> if_>
+struct Flows<if_> {
+  using Mentions =
+      _impl_::Merge<typename Live<if_.cond>::Mentions,
+                    typename Live<if_.iftrue>::Mentions,
+                    typename Live<if_.iffalse>::Mentions>::Result;
+
+  static constexpr auto summary =
+      _impl_::branch(Live<if_.cond>::summary, Live<if_.iftrue>::summary,
+                     Live<if_.iffalse>::summary);
+};
+
+template <typename Code, code::ctrl::LoopBlock<Code> loop> struct Flows<loop> {
+  using Mentions = Live<loop.code>::Mentions;
+
+  static constexpr auto summary = _impl_::loop(Live<loop.code>::summary);
+};
+
+namespace _impl_ {
+
+template <typename T> struct Ends {
+  static constexpr bool value = false;
+};
+
+template <typename T> struct Ends<code::ctrl::Break<T>> {
+  static constexpr bool value = true;
+};
+
+// Whether a statement is a loop that may run more than once, unlike
+// `block_`s, which end in an unconditional `break_`.
+template <typename T> struct Repeats {
+  static constexpr bool value = false;
+};
+
+template <typename Code> struct Repeats<ir::IR<Code>> : Repeats<Code> {};
+
+template <typename Code> struct Repeats<code::ctrl::LoopBlock<Code>> {
+  static constexpr bool value = true;
+};
+
+template <typename... Code>
+  requires(sizeof...(Code) > 0)
+struct Repeats<code::ctrl::LoopBlock<code::ctrl::Block<Code...>>> {
+  static constexpr bool value = !Ends<detail::tfunc::_impl_::Element<
+      sizeof...(Code) - 1, Code...>>::value;
+};
+
+// What a statement forgets right after it: what it mentions that is then
+// dead, and left alone by later statements and by what encloses it.
+template <auto... names>
+constexpr Keys forgets(Names<names...>, Keys const &live, Keys const &later,
+                       Keys const &deferred) noexcept {
+  Keys kills{};
+  (
+      [&] {
+        constexpr auto key = key_of<names>();
+        if (!live.has(key) && !later.has(key) && !deferred.has(key))
+          kills.add(key);
+      }(),
+      ...);
+  return kills;
+}
+
+template <auto... names>
+constexpr unsigned count(Names<names...>, Keys const &keys) noexcept {
+  return (0 + ... + unsigned(keys.has(key_of<names>())));
+}
+
+// Statements forgetting those of `names` in `keys`, spelled out in one go.
+template <Keys keys, auto... names>
+constexpr auto drops(Names<names...>) noexcept {
+  constexpr auto all = bundle_of(code::Drop{names}...);
+  constexpr auto kept = [] {
+    struct {
+      unsigned at[sizeof...(names) + 1];
+      unsigned size;
+    } kept{};
+    unsigned i = 0;
+    ((keys.has(key_of<names>()) ? void(kept.at[kept.size++] = i++)
+                                : void(i++)),
+     ...);
+    return kept;
+  }();
+  return [&]<unsigned... is>(detail::tfunc::_impl_::Indices<is...>) {
+    return bundle_of(all.template get<kept.at[is]>()...);
+  }(detail::tfunc::_impl_::MakeIndices<kept.size>{});
+}
+
+} // namespace _impl_
+
+// Drops stores to scratch names that are dead, and statements forgetting
+// scratch names once they are dead, so that the state only holds what is
+// still to be read. `deferred` are the names an enclosing statement forgets
+// right after, and `value` whether the code's result is used.
+template <auto code, _impl_::Keys out, _impl_::Flow flow,
+          _impl_::Keys deferred, bool value>
+struct Prune {
+  static constexpr auto result = code;
+};
+
+// An item of a pruned list of statements: a statement, or one of the drops
+// after it. Statements mentioning no scratch names are left as they are.
+template <auto statement, _impl_::Keys out, _impl_::Flow flow,
+          _impl_::Keys deferred, bool value, _impl_::Keys kills, unsigned item>
+struct Piece {
+  using Mentions = Live<statement>::Mentions;
+
+  static constexpr auto result = [] {
+    if constexpr (item > 0)
+      return _impl_::drops<kills>(Mentions{}).template get<item - 1>();
+    else if constexpr (__is_same(Mentions, _impl_::Names<>))
+      return statement;
+    else
+      return Prune<statement, out, flow, deferred, value>::result;
+  }();
+};
+
+template <auto code, _impl_::Keys out, _impl_::Flow flow,
+          _impl_::Keys deferred, bool value>
+struct Statements;
+
+// Planned in a single pass, since every member instantiated here is keyed by
+// the whole list.
+template <typename... Code, bundle::Bundle<Code...> code, _impl_::Keys out,
+          _impl_::Flow flow, _impl_::Keys deferred, bool value>
+struct Statements<code, out, flow, deferred, value> {
+  static constexpr unsigned n = sizeof...(Code);
+
+  // Before each statement, what is live, and what it or a later statement
+  // mentions; after it, what it forgets, and what its parts leave to it.
+  struct Plan {
+    _impl_::Keys live[n + 1];
+    _impl_::Keys later[n + 1];
+    _impl_::Keys kills[n];
+    _impl_::Keys inner[n];
+    unsigned size;
+  };
+
+  template <unsigned... is>
+  static constexpr Plan walk(detail::tfunc::_impl_::Indices<is...>) {
+    Plan plan{};
+    plan.live[n] = out;
+    plan.size = n;
+    (
+        [&]<unsigned i, auto statement>() {
+          using Mentions = Live<statement>::Mentions;
+          plan.live[i] = Live<statement>::summary.in(plan.live[i + 1], flow);
+          plan.later[i] = plan.later[i + 1];
+          plan.later[i].merge(_impl_::keys_of(Mentions{}));
+          // Nothing is appended where it would change the result, or could
+          // not run.
+          if ((i + 1 < n || !value) &&
+              !requires { code::ctrl::_impl_::Flow<statement>{}; })
+            plan.kills[i] = _impl_::forgets(Mentions{}, plan.live[i + 1],
+                                            plan.later[i + 1], deferred);
+          plan.inner[i] = deferred;
+          if (!_impl_::Repeats<decltype(statement)>::value)
+            plan.inner[i].merge(plan.kills[i]);
+          plan.size += _impl_::count(Mentions{}, plan.kills[i]);
+        }.template operator()<n - 1 - is, code.template get<n - 1 - is>()>(),
+        ...);
+    return plan;
+  }
+
+  static constexpr Plan plan = walk(detail::tfunc::_impl_::MakeIndices<n>{});
+
+  // Where each item of the result comes from.
+  struct Layout {
+    unsigned statement[plan.size];
+    unsigned item[plan.size];
+  };
+
+  template <unsigned... is>
+  static constexpr Layout lay(detail::tfunc::_impl_::Indices<is...>) {
+    Layout layout{};
+    unsigned k = 0;
+    (
+        [&]<auto statement>() {
+          using Mentions = Live<statement>::Mentions;
+          auto const items = 1 + _impl_::count(Mentions{}, plan.kills[is]);
+          for (unsigned item = 0; item < items; ++item, ++k) {
+            layout.statement[k] = is;
+            layout.item[k] = item;
+          }
+        }.template operator()<code.template get<is>()>(),
+        ...);
+    return layout;
+  }
+
+  static constexpr Layout layout = lay(detail::tfunc::_impl_::MakeIndices<n>{});
+
+  template <unsigned... ks>
+  static constexpr auto apply(detail::tfunc::_impl_::Indices<ks...>) {
+    return _impl_::bundle_of(
+        Piece<code.template get<layout.statement[ks]>(),
+              plan.live[layout.statement[ks] + 1], flow,
+              plan.inner[layout.statement[ks]],
+              value && layout.statement[ks] + 1 == n,
+              plan.kills[layout.statement[ks]], layout.item[ks]>::result...);
+  }
+
+  static constexpr auto result =
+      apply(detail::tfunc::_impl_::MakeIndices<plan.size>{});
+};
+
+template <typename T, typename... Ts, bundle::Bundle<T, Ts...> bundle,
+          _impl_::Keys out, _impl_::Flow flow, _impl_::Keys deferred,
+          bool value>
+struct Prune<bundle, out, flow, deferred, value> {
+  static constexpr auto result =
+      Statements<bundle, out, flow, deferred, value>::result;
+};
+
+template <typename Code, ir::IR<Code> ir, _impl_::Keys out, _impl_::Flow flow,
+          _impl_::Keys deferred, bool value>
+struct Prune<ir, out, flow, deferred, value> {
+  static constexpr auto result =
+      _impl_::ir_of(Prune<ir.code, out, flow, deferred, value>::result);
+};
+
+template <typename Lhs, typename Rhs, code::Operator<"=", Lhs, Rhs> op,
+          _impl_::Keys out, _impl_::Flow flow, _impl_::Keys deferred,
+          bool value>
+struct Prune<op, out, flow, deferred, value> {
+  static constexpr auto result = [] {
+    if constexpr (requires { Store<op.args>::dead(out); }) {
+      if constexpr (Store<op.args>::dead(out))
+        return op.args.template get<1>();
+      else
+        return op;
+    } else {
+      return op;
+    }
+  }();
+};
+
+template <typename Var, typename Expr, code::Assign<Var, Expr> assign,
+          _impl_::Keys out, _impl_::Flow flow, _impl_::Keys deferred,
+          bool value>
+struct Prune<assign, out, flow, deferred, value> {
+  static constexpr auto args = _impl_::bundle_of(assign.var, assign.expr);
+
+  static constexpr auto result = [] {
+    if constexpr (requires { Store<args>::dead(out); }) {
+      if constexpr (Store<args>::dead(out))
+        return assign.expr;
+      else
+        return assign;
+    } else {
+      return assign;
+    }
+  }();
+};
+
+template <typename... Code, code::ctrl::Block<Code...> block, _impl_::Keys out,
+          _impl_::Flow flow, _impl_::Keys deferred, bool value>
+  requires(sizeof...(Code) > 0)
+struct Prune<block, out, flow, deferred, value> {
+  static constexpr auto result = _impl_::block_of(
+      Statements<block.code, out, flow, deferred, value>::result);
+};
+
+template <typename Cond, typename IfTrue, typename IfFalse,
+          code::ctrl::IfBlock<Cond, IfTrue, IfFalse> if_, _impl_::Keys out,
+          _impl_::Flow flow, _impl_::Keys deferred, bool value>
+struct Prune<if_, out, flow, deferred, value> {
+  template <auto branch>
+  static constexpr auto prune =
+      Prune<branch, out, flow, deferred, value>::result;
+
+  static constexpr auto result = [] {
+    if constexpr (__is_same(IfFalse, void))
+      return _impl_::if_of(if_.cond, prune<if_.iftrue>);
+    else
+      return _impl_::if_of(if_.cond, prune<if_.iftrue>, prune<if_.iffalse>);
+  }();
+};
+
+template <typename Code, code::ctrl::LoopBlock<Code> loop, _impl_::Keys out,
+          _impl_::Flow flow, _impl_::Keys deferred, bool value>
+struct Prune<loop, out, flow, deferred, value> {
+  static constexpr auto head = Live<loop>::summary.in(out, flow);
+
+  static constexpr auto result = code::ctrl::LoopBlock{
+      Prune<loop.code, head, _impl_::Flow{out, head}, deferred, false>::result};
+};
+
+template <auto code>
+static constexpr auto prune =
+    Prune<code, _impl_::Keys{}, _impl_::Flow{}, _impl_::Keys{}, false>::result;
+
+// The base of the names of temporaries holding lookups shared within a
+// statement, subscripted by the digest of the lookup.
+struct Shared : Scratch {
+  constexpr bool operator==(Shared const &) const noexcept { return true; }
+};
+
+namespace _impl_ {
+
+// Names a lookup may spell out: integers, enums and empty structs, and
+// bundles of those.
+template <typename T> constexpr bool spelled(T const &) noexcept {
+  if constexpr (__is_class(T))
+    return __is_empty(T);
+  else
+    return __is_enum(T) || requires(T value) { value % value; };
+}
+
+template <typename T, typename... Ts>
+constexpr bool spelled(bundle::Bundle<T, Ts...> const &name) noexcept {
+  return spelled(name.head) && spelled(name.tail);
+}
+
+template <typename> struct Tag {};
+
+constexpr unsigned long long mix(unsigned long long hash,
+                                 unsigned long long value) noexcept {
+  return (hash ^ value) * 0x100000001b3ull;
+}
+
+// A digest of a chain of lookups. Constants are told apart by type too, so
+// chains only share a digest if they look up the same variables.
+template <typename T> constexpr unsigned long long digest(T const &value) noexcept {
+  if constexpr (__is_class(T) && __is_empty(T))
+    return detail::tfunc::_impl_::hash<T{}>;
+  else if constexpr (__is_class(T))
+    return 0;
+  else
+    return mix(detail::tfunc::_impl_::hash<Tag<T>{}>,
+               static_cast<unsigned long long>(value));
+}
+
+template <typename T, typename... Ts>
+constexpr unsigned long long
+digest(bundle::Bundle<T, Ts...> const &bundle) noexcept;
+
+template <typename Name>
+constexpr unsigned long long digest(code::Var<Name> const &var) noexcept {
+  return mix(1, digest(var.name));
+}
+
+template <detail::string::StringLiteral name, typename... Args>
+constexpr unsigned long long
+digest(code::Operator<name, Args...> const &op) noexcept {
+  return mix(detail::tfunc::_impl_::hash<name>, digest(op.args));
+}
+
+template <typename T, typename... Ts>
+constexpr unsigned long long
+digest(bundle::Bundle<T, Ts...> const &bundle) noexcept {
+  return mix(digest(bundle.tail), digest(bundle.head));
+}
+
+// The variable a name belongs to, for telling which stores may change a
+// lookup. This errs towards calling names the same, as the state does for
+// integers and enums of equal value.
+template <typename T> constexpr unsigned long long root(T const &name) noexcept {
+  if constexpr (__is_class(T) && __is_empty(T))
+    return detail::tfunc::_impl_::hash<T{}>;
+  else if constexpr (__is_class(T))
+    return 0;
+  else
+    return static_cast<unsigned long long>(name);
+}
+
+template <typename T, typename... Ts>
+constexpr unsigned long long
+root(bundle::Bundle<T, Ts...> const &name) noexcept {
+  return root(name.head);
+}
+
+// How many variables a chain of lookups reads, like `*var_(ARRAY)`'s
+// `var_(ARRAY)`, or -1 for other code. A chain only reads the state, and
+// subscripts by constants or by the values of other chains.
+template <typename T> constexpr int lookups(T const &) noexcept { return -1; }
+
+template <typename Name>
+constexpr int lookups(code::Var<Name> const &var) noexcept {
+  return spelled(var.name) ? 1 : -1;
+}
+
+template <typename Base, typename... Subs>
+constexpr int lookups(code::Operator<"[]", Base, Subs...> const &op) noexcept;
+
+template <typename T> constexpr int index(T const &sub) noexcept {
+  return constant(sub) ? 0 : -1;
+}
+
+template <typename Arg>
+constexpr int index(code::Operator<"*#", Arg> const &op) noexcept {
+  return lookups(op.args.head);
+}
+
+constexpr int indices(bundle::Bundle<> const &) noexcept { return 0; }
+
+template <typename T, typename... Ts>
+constexpr int indices(bundle::Bundle<T, Ts...> const &subs) noexcept {
+  auto const head = index(subs.head);
+  auto const tail = indices(subs.tail);
+  return head < 0 || tail < 0 ? -1 : head + tail;
+}
+
+template <typename Base, typename... Subs>
+constexpr int lookups(code::Operator<"[]", Base, Subs...> const &op) noexcept {
+  auto const base = lookups(op.args.head);
+  auto const subs = indices(op.args.tail);
+  return base < 0 || subs < 0 ? -1 : base + subs;
+}
+
+// Only chains reading more than one variable are worth sharing, since
+// reading the temporary is a lookup too.
+template <typename T> constexpr bool chain(T const &code) noexcept {
+  return lookups(code) > 1;
+}
+
+// Whether code of some type may be a chain at all.
+template <typename T> struct Chained {
+  static constexpr bool value = false;
+};
+
+template <typename Name> struct Chained<code::Var<Name>> {
+  static constexpr bool value = true;
+};
+
+template <typename Base, typename... Subs>
+struct Chained<code::Operator<"[]", Base, Subs...>> {
+  static constexpr bool value = true;
+};
+
+// A chain some code reads: its digest, the variables it reads, and whether
+// it is read more than once.
+struct Chain {
+  static constexpr unsigned capacity = 4;
+
+  unsigned long long digest = 0;
+  unsigned long long roots[capacity]{};
+  unsigned size = 0;
+  bool fits = true;
+  unsigned uses = 1;
+  bool repeats = false;
+
+  constexpr void add(unsigned long long root) noexcept {
+    for (unsigned i = 0; i < size; ++i)
+      if (roots[i] == root)
+        return;
+    if (size == capacity)
+      fits = false;
+    else
+      roots[size++] = root;
+  }
+};
+
+template <typename T> constexpr void roots(Chain &, T const &) noexcept {}
+
+constexpr void roots(Chain &, bundle::Bundle<> const &) noexcept {}
+
+template <typename T, typename... Ts>
+constexpr void roots(Chain &chain, bundle::Bundle<T, Ts...> const &code) noexcept;
+
+template <typename Name>
+constexpr void roots(Chain &chain, code::Var<Name> const &var) noexcept {
+  chain.add(root(var.name));
+}
+
+template <detail::string::StringLiteral name, typename... Args>
+constexpr void roots(Chain &chain,
+                     code::Operator<name, Args...> const &op) noexcept {
+  roots(chain, op.args);
+}
+
+template <typename T, typename... Ts>
+constexpr void roots(Chain &chain,
+                     bundle::Bundle<T, Ts...> const &code) noexcept {
+  roots(chain, code.head);
+  roots(chain, code.tail);
+}
+
+// The digests of the chains read from temporaries.
+struct Digests {
+  static constexpr unsigned capacity = 8;
+
+  unsigned long long at[capacity]{};
+  unsigned size = 0;
+
+  constexpr bool has(unsigned long long digest) const noexcept {
+    for (unsigned i = 0; i < size; ++i)
+      if (at[i] == digest)
+        return true;
+    return false;
+  }
+
+  constexpr void add(unsigned long long digest) noexcept {
+    if (size < capacity && !has(digest))
+      at[size++] = digest;
+  }
+
+  constexpr Digests with(Digests const &other) const noexcept {
+    auto digests = *this;
+    for (unsigned i = 0; i < other.size; ++i)
+      digests.add(other.at[i]);
+    return digests;
+  }
+};
+
+// The chains some code reads, and the variables it may store to. Chains
+// that do not fit are left unshared.
+struct Uses {
+  static constexpr unsigned capacity = 16;
+
+  Chain chains[capacity]{};
+  unsigned size = 0;
+  unsigned long long stores[capacity]{};
+  unsigned stored = 0;
+  // Whether it may store to any variable, e.g. by calling a function.
+  bool anything = false;
+  // Whether it has a block with chains to share.
+  bool nested = false;
+
+  constexpr void use(Chain const &chain) noexcept {
+    for (unsigned i = 0; i < size; ++i)
+      if (chains[i].digest == chain.digest) {
+        ++chains[i].uses;
+        chains[i].repeats = chains[i].repeats || chain.repeats;
+        return;
+      }
+    if (size < capacity)
+      chains[size++] = chain;
+  }
+
+  constexpr void store(unsigned long long root) noexcept {
+    for (unsigned i = 0; i < stored; ++i)
+      if (stores[i] == root)
+        return;
+    if (stored == capacity)
+      anything = true;
+    else
+      stores[stored++] = root;
+  }
+
+  constexpr bool changes(Chain const &chain) const noexcept {
+    for (unsigned i = 0; i < chain.size; ++i)
+      for (unsigned j = 0; j < stored; ++j)
+        if (chain.roots[i] == stores[j])
+          return true;
+    return false;
+  }
+};
+
+// How an operator treats its operands: as values, as variables it stores
+// to, or as functions to call.
+enum class Role { plain, read, store, call };
+
+template <unsigned n>
+constexpr Role role_of(detail::string::StringLiteral<n> const &name) noexcept {
+  using vm::Operation;
+  auto const op = vm::_impl_::operation_of(name);
+  switch (op) {
+  case Operation::Call:
+    return Role::call;
+  case Operation::Assign:
+  case Operation::PreInc:
+  case Operation::PreDec:
+  case Operation::PostInc:
+  case Operation::PostDec:
+    return Role::store;
+  case Operation::AddressOf:
+  case Operation::Index:
+  case Operation::Unsupported:
+    return Role::plain;
+  default:
+    return vm::_impl_::is_update(name) ? Role::store : Role::read;
+  }
+}
+
+template <typename T>
+constexpr void scan(Uses &uses, T const &code, Digests const &shared,
+                    bool repeats) noexcept;
+
+template <typename T>
+constexpr void operand(Uses &uses, T const &code, Digests const &shared,
+                       bool repeats) noexcept {
+  if constexpr (Chained<T>::value) {
+    if (chain(code)) {
+      Chain read{digest(code)};
+      read.repeats = repeats;
+      roots(read, code);
+      uses.use(read);
+      return;
+    }
+  }
+  scan(uses, code, shared, repeats);
+}
+
+constexpr void operands(Uses &, bundle::Bundle<> const &, Digests const &,
+                        bool) noexcept {}
+
+template <typename T, typename... Ts>
+constexpr void operands(Uses &uses, bundle::Bundle<T, Ts...> const &code,
+                        Digests const &shared, bool repeats) noexcept {
+  operand(uses, code.head, shared, repeats);
+  operands(uses, code.tail, shared, repeats);
+}
+
+// A variable stored to. Subscripts are read as usual; stores through
+// anything but a name may reach any variable.
+template <typename T>
+constexpr void target(Uses &uses, T const &code, Digests const &shared,
+                      bool repeats) noexcept {
+  uses.anything = true;
+  scan(uses, code, shared, repeats);
+}
+
+template <typename Code>
+constexpr void target(Uses &uses, ir::IR<Code> const &ir,
+                      Digests const &shared, bool repeats) noexcept {
+  target(uses, ir.code, shared, repeats);
+}
+
+template <typename Name>
+constexpr void target(Uses &uses, code::Var<Name> const &var,
+                      Digests const &shared, bool repeats) noexcept {
+  if (spelled(var.name))
+    uses.store(root(var.name));
+  else
+    target(uses, var.name, shared, repeats);
+}
+
+template <typename Base, typename... Subs>
+constexpr void target(Uses &uses,
+                      code::Operator<"[]", Base, Subs...> const &op,
+                      Digests const &shared, bool repeats) noexcept {
+  target(uses, op.args.head, shared, repeats);
+  scan(uses, op.args.tail, shared, repeats);
+}
+
+template <typename T>
+constexpr Digests picks(T const &statement, Digests const &shared) noexcept;
+
+constexpr bool nests(bundle::Bundle<> const &, Digests const &) noexcept {
+  return false;
+}
+
+template <typename T, typename... Ts>
+constexpr bool nests(bundle::Bundle<T, Ts...> const &code,
+                     Digests const &shared) noexcept {
+  return picks(code.head, shared).size > 0 || nests(code.tail, shared);
+}
+
+constexpr void scan(Uses &, bundle::Bundle<> const &, Digests const &,
+                    bool) noexcept {}
+
+template <typename T, typename... Ts>
+constexpr void scan(Uses &uses, bundle::Bundle<T, Ts...> const &code,
+                    Digests const &shared, bool repeats) noexcept {
+  scan(uses, code.head, shared, repeats);
+  scan(uses, code.tail, shared, repeats);
+}
+
+template <typename Code>
+constexpr void scan(Uses &uses, ir::IR<Code> const &ir, Digests const &shared,
+                    bool repeats) noexcept {
+  scan(uses, ir.code, shared, repeats);
+}
+
+template <typename Name>
+constexpr void scan(Uses &uses, code::Var<Name> const &var,
+                    Digests const &shared, bool repeats) noexcept {
+  scan(uses, var.name, shared, repeats);
+}
+
+template <typename Name>
+constexpr void scan(Uses &uses, code::Ref<Name> const &ref,
+                    Digests const &shared, bool repeats) noexcept {
+  scan(uses, ref.name, shared, repeats);
+}
+
+template <typename Name>
+constexpr void scan(Uses &uses, code::Drop<Name> const &drop,
+                    Digests const &shared, bool repeats) noexcept {
+  target(uses, code::Var<Name>{drop.name}, shared, repeats);
+}
+
+template <typename Var, typename Expr>
+constexpr void scan(Uses &uses, code::Assign<Var, Expr> const &assign,
+                    Digests const &shared, bool repeats) noexcept {
+  target(uses, assign.var, shared, repeats);
+  scan(uses, assign.expr, shared, repeats);
+}
+
+template <detail::string::StringLiteral name, typename... Args>
+constexpr void scan(Uses &uses, code::Operator<name, Args...> const &op,
+                    Digests const &shared, bool repeats) noexcept {
+  constexpr auto role = role_of(name);
+  if constexpr (role == Role::call) {
+    uses.anything = true;
+  } else if constexpr (role == Role::store) {
+    target(uses, op.args.head, shared, repeats);
+    scan(uses, op.args.tail, shared, repeats);
+  } else if constexpr (role == Role::read) {
+    operands(uses, op.args, shared, repeats);
+  } else {
+    scan(uses, op.args, shared, repeats);
+  }
+}
+
+template <typename To, typename From>
+constexpr void scan(Uses &uses, code::Cast<To, From> const &cast,
+                    Digests const &shared, bool repeats) noexcept {
+  operand(uses, cast.from, shared, repeats);
+}
+
+template <typename Offset>
+constexpr void scan(Uses &uses, code::Peek<Offset> const &peek,
+                    Digests const &shared, bool repeats) noexcept {
+  scan(uses, peek.offset, shared, repeats);
+}
+
+template <typename Offset>
+constexpr void scan(Uses &uses, code::Advance<Offset> const &advance,
+                    Digests const &shared, bool repeats) noexcept {
+  scan(uses, advance.offset, shared, repeats);
+}
+
+template <typename Ch>
+constexpr void scan(Uses &uses, code::PutC<Ch> const &putc,
+                    Digests const &shared, bool repeats) noexcept {
+  scan(uses, putc.ch, shared, repeats);
+}
+
+template <typename Fn, typename... Args>
+constexpr void scan(Uses &uses, code::Invoke<Fn, Args...> const &,
+                    Digests const &, bool) noexcept {
+  uses.anything = true;
+}
+
+template <typename T>
+constexpr void scan(Uses &uses, code::ctrl::Break<T> const &break_,
+                    Digests const &shared, bool repeats) noexcept {
+  scan(uses, break_.result, shared, repeats);
+}
+
+template <typename... Code>
+constexpr void scan(Uses &uses, code::ctrl::Block<Code...> const &block,
+                    Digests const &shared, bool repeats) noexcept {
+  scan(uses, block.code, shared, repeats);
+  uses.nested = uses.nested || nests(block.code, shared);
+}
+
+template <typename Cond, typename IfTrue, typename IfFalse>
+constexpr void scan(Uses &uses,
+                    code::ctrl::IfBlock<Cond, IfTrue, IfFalse> const &if_,
+                    Digests const &shared, bool repeats) noexcept {
+  scan(uses, if_.cond, shared, repeats);
+  scan(uses, if_.iftrue, shared, repeats);
+  scan(uses, if_.iffalse, shared, repeats);
+}
+
+template <typename Code>
+constexpr void scan(Uses &uses, code::ctrl::LoopBlock<Code> const &loop,
+                    Digests const &shared, bool repeats) noexcept {
+  scan(uses, loop.code, shared,
+       repeats || Repeats<code::ctrl::LoopBlock<Code>>::value);
+}
+
+// Anything else is a literal, or stores who knows where.
+template <typename T>
+constexpr void scan(Uses &uses, T const &code, Digests const &,
+                    bool) noexcept {
+  uses.anything = uses.anything || !inert(code);
+}
+
+// The chains a statement reads more than once, or in a loop, that nothing in
+// it may change. A chain never fails, so it can be read ahead of the
+// statement, even if the statement would not have read it at all.
+template <typename T>
+constexpr Digests picks(T const &statement, Digests const &shared) noexcept {
+  Uses uses{};
+  scan(uses, statement, shared, false);
+  Digests picks{};
+  if (uses.anything)
+    return picks;
+  for (unsigned i = 0; i < uses.size; ++i) {
+    auto const &chain = uses.chains[i];
+    if (chain.fits && (chain.uses > 1 || chain.repeats) &&
+        !shared.has(chain.digest) && !uses.changes(chain))
+      picks.add(chain.digest);
+  }
+  return picks;
+}
+
+// Whether code reads a chain from `shared`, or has one to share itself, and
+// so needs rewriting.
+template <typename T>
+constexpr bool stale(T const &code, Digests const &shared) noexcept {
+  Uses uses{};
+  scan(uses, code, shared, false);
+  for (unsigned i = 0; i < uses.size; ++i)
+    if (shared.has(uses.chains[i].digest))
+      return true;
+  return uses.nested;
+}
+
+template <typename T>
+constexpr bool contains(T const &code, unsigned long long digest) noexcept;
+
+constexpr bool contains(bundle::Bundle<> const &, unsigned long long) noexcept {
+  return false;
+}
+
+template <typename T, typename... Ts>
+constexpr bool contains(bundle::Bundle<T, Ts...> const &code,
+                        unsigned long long digest) noexcept {
+  return contains(code.head, digest) || contains(code.tail, digest);
+}
+
+// The code a chain may be found in.
+template <typename T> constexpr auto parts(T const &) noexcept {
+  return bundle::Bundle<>{};
+}
+
+template <typename Code> constexpr auto parts(ir::IR<Code> const &ir) noexcept {
+  return bundle_of(ir.code);
+}
+
+template <typename Name>
+constexpr auto parts(code::Var<Name> const &var) noexcept {
+  return bundle_of(var.name);
+}
+
+template <typename Var, typename Expr>
+constexpr auto parts(code::Assign<Var, Expr> const &assign) noexcept {
+  return bundle_of(assign.var, assign.expr);
+}
+
+template <detail::string::StringLiteral name, typename... Args>
+constexpr auto parts(code::Operator<name, Args...> const &op) noexcept {
+  return op.args;
+}
+
+template <typename To, typename From>
+constexpr auto parts(code::Cast<To, From> const &cast) noexcept {
+  return bundle_of(cast.from);
+}
+
+template <typename Offset>
+constexpr auto parts(code::Peek<Offset> const &peek) noexcept {
+  return bundle_of(peek.offset);
+}
+
+template <typename Offset>
+constexpr auto parts(code::Advance<Offset> const &advance) noexcept {
+  return bundle_of(advance.offset);
+}
+
+template <typename Ch>
+constexpr auto parts(code::PutC<Ch> const &putc) noexcept {
+  return bundle_of(putc.ch);
+}
+
+template <typename T>
+constexpr auto parts(code::ctrl::Break<T> const &break_) noexcept {
+  return bundle_of(break_.result);
+}
+
+template <typename... Code>
+constexpr auto parts(code::ctrl::Block<Code...> const &block) noexcept {
+  return block.code;
+}
+
+template <typename Cond, typename IfTrue, typename IfFalse>
+constexpr auto
+parts(code::ctrl::IfBlock<Cond, IfTrue, IfFalse> const &if_) noexcept {
+  return bundle_of(if_.cond, if_.iftrue, if_.iffalse);
+}
+
+template <typename Code>
+constexpr auto parts(code::ctrl::LoopBlock<Code> const &loop) noexcept {
+  return bundle_of(loop.code);
+}
+
+template <typename T>
+constexpr bool contains(T const &code, unsigned long long digest) noexcept {
+  if constexpr (Chained<T>::value)
+    if (chain(code) && _impl_::digest(code) == digest)
+      return true;
+  return contains(parts(code), digest);
+}
+
+template <unsigned long long digest> constexpr auto temporary() noexcept {
+  return code::Var{bundle_of(Shared{}, digest)};
+}
+
+} // namespace _impl_
+
+// The first chain with a given digest in some code.
+template <auto code, unsigned long long digest> struct Find {
+  static constexpr auto result = [] {
+    if constexpr (_impl_::chain(code)) {
+      if constexpr (_impl_::digest(code) == digest)
+        return code;
+      else
+        return Find<_impl_::parts(code), digest>::result;
+    } else {
+      return Find<_impl_::parts(code), digest>::result;
+    }
+  }();
+};
+
+template <typename... Code, bundle::Bundle<Code...> bundle,
+          unsigned long long digest>
+  requires(sizeof...(Code) > 0)
+struct Find<bundle, digest> {
+  static constexpr auto result = [] {
+    if constexpr (_impl_::contains(bundle.head, digest))
+      return Find<bundle.head, digest>::result;
+    else
+      return Find<bundle.tail, digest>::result;
+  }();
+};
+
+// Reads the chains in `shared` from the temporaries holding them, and has
+// each statement read the chains it shares into temporaries first.
+template <auto code, _impl_::Digests shared> struct Share {
+  static constexpr auto result = code;
+};
+
+template <auto code, _impl_::Digests shared = _impl_::Digests{}>
+static constexpr auto share = [] {
+  if constexpr (_impl_::stale(code, shared))
+    return Share<code, shared>::result;
+  else
+    return code;
+}();
+
+// An operand read as a value, which may be a shared chain.
+template <auto code, _impl_::Digests shared>
+static constexpr auto share_operand = [] {
+  if constexpr (_impl_::chain(code)) {
+    if constexpr (shared.has(_impl_::digest(code)))
+      return _impl_::temporary<_impl_::digest(code)>();
+    else
+      return code;
+  } else {
+    return share<code, shared>;
+  }
+}();
+
+template <typename... Code, bundle::Bundle<Code...> bundle,
+          _impl_::Digests shared>
+  requires(sizeof...(Code) > 0)
+struct Share<bundle, shared> {
+  template <unsigned... is>
+  static constexpr auto apply(detail::tfunc::_impl_::Indices<is...>) {
+    return _impl_::bundle_of(share<bundle.template get<is>(), shared>...);
+  }
+
+  static constexpr auto result =
+      apply(detail::tfunc::_impl_::MakeIndices<sizeof...(Code)>{});
+};
+
+template <typename Code, ir::IR<Code> ir, _impl_::Digests shared>
+struct Share<ir, shared> {
+  static constexpr auto result = _impl_::ir_of(share<ir.code, shared>);
+};
+
+template <typename Var, typename Expr, code::Assign<Var, Expr> assign,
+          _impl_::Digests shared>
+struct Share<assign, shared> {
+  static constexpr auto result = code::Assign{share<assign.var, shared>,
+                                              share<assign.expr, shared>};
+};
+
+template <detail::string::StringLiteral name, typename... Args,
+          code::Operator<name, Args...> op, _impl_::Digests shared>
+struct Share<op, shared> {
+  template <unsigned... is>
+  static constexpr auto apply(detail::tfunc::_impl_::Indices<is...>) {
+    if constexpr (_impl_::role_of(name) == _impl_::Role::read)
+      return _impl_::operator_of<name>(_impl_::bundle_of(
+          share_operand<op.args.template get<is>(), shared>...));
+    else
+      return _impl_::operator_of<name>(
+          _impl_::bundle_of(share<op.args.template get<is>(), shared>...));
+  }
+
+  static constexpr auto result =
+      apply(detail::tfunc::_impl_::MakeIndices<sizeof...(Args)>{});
+};
+
+template <typename To, typename From, code::Cast<To, From> cast,
+          _impl_::Digests shared>
+struct Share<cast, shared> {
+  static constexpr auto result =
+      _impl_::cast_of<To>(share_operand<cast.from, shared>);
+};
+
+template <typename Offset, code::Peek<Offset> peek, _impl_::Digests shared>
+struct Share<peek, shared> {
+  static constexpr auto result = code::Peek{share<peek.offset, shared>};
+};
+
+template <typename Offset, code::Advance<Offset> advance,
+          _impl_::Digests shared>
+struct Share<advance, shared> {
+  static constexpr auto result = code::Advance{share<advance.offset, shared>};
+};
+
+template <typename Ch, code::PutC<Ch> putc, _impl_::Digests shared>
+struct Share<putc, shared> {
+  static constexpr auto result = code::PutC{share<putc.ch, shared>};
+};
+
+template <typename T, code::ctrl::Break<T> break_, _impl_::Digests shared>
+struct Share<break_, shared> {
+  static constexpr auto result =
+      _impl_::break_of(share<break_.result, shared>);
+};
+
+template <typename Cond, typename IfTrue, typename IfFalse,
+          code::ctrl::IfBlock<Cond, IfTrue, IfFalse> if_,
+          _impl_::Digests shared>
+struct Share<if_, shared> {
+  static constexpr auto result = [] {
+    if constexpr (__is_same(IfFalse, void))
+      return _impl_::if_of(share<if_.cond, shared>,
+                           share<if_.iftrue, shared>);
+    else
+      return _impl_::if_of(share<if_.cond, shared>, share<if_.iftrue, shared>,
+                           share<if_.iffalse, shared>);
+  }();
+};
+
+template <typename Code, code::ctrl::LoopBlock<Code> loop,
+          _impl_::Digests shared>
+struct Share<loop, shared> {
+  static constexpr auto result =
+      code::ctrl::LoopBlock{share<loop.code, shared>};
+};
+
+// An item of a block's statements: a read of a chain into its temporary,
+// or the statement after those.
+template <auto statement, _impl_::Digests shared, _impl_::Digests picks,
+          unsigned item>
+struct Hoist {
+  static constexpr auto result = [] {
+    if constexpr (item < picks.size) {
+      constexpr auto digest = picks.at[item];
+      return _impl_::operator_of<"=">(_impl_::bundle_of(
+          _impl_::temporary<digest>(),
+          _impl_::operator_of<"*#">(
+              _impl_::bundle_of(Find<statement, digest>::result))));
+    } else {
+      return share<statement, shared.with(picks)>;
+    }
+  }();
+};
+
+template <typename... Code, code::ctrl::Block<Code...> block,
+          _impl_::Digests shared>
+  requires(sizeof...(Code) > 0)
+struct Share<block, shared> {
+  static constexpr unsigned n = sizeof...(Code);
+
+  struct Plan {
+    _impl_::Digests picks[n];
+    unsigned size;
+  };
+
+  template <unsigned... is>
+  static constexpr Plan plan_of(detail::tfunc::_impl_::Indices<is...>) {
+    Plan plan{{_impl_::picks(block.code.template get<is>(), shared)...}, n};
+    for (auto const &picks : plan.picks)
+      plan.size += picks.size;
+    return plan;
+  }
+
+  static constexpr Plan plan =
+      plan_of(detail::tfunc::_impl_::MakeIndices<n>{});
+
+  // Where each item of the result comes from.
+  struct Layout {
+    unsigned statement[plan.size];
+    unsigned item[plan.size];
+  };
+
+  static constexpr Layout layout = [] {
+    Layout layout{};
+    unsigned k = 0;
+    for (unsigned i = 0; i < n; ++i)
+      for (unsigned item = 0; item <= plan.picks[i].size; ++item, ++k) {
+        layout.statement[k] = i;
+        layout.item[k] = item;
+      }
+    return layout;
+  }();
+
+  template <unsigned... ks>
+  static constexpr auto apply(detail::tfunc::_impl_::Indices<ks...>) {
+    return _impl_::block_of(_impl_::bundle_of(
+        Hoist<block.code.template get<layout.statement[ks]>(), shared,
+              plan.picks[layout.statement[ks]], layout.item[ks]>::result...));
+  }
+
+  static constexpr auto result =
+      apply(detail::tfunc::_impl_::MakeIndices<plan.size>{});
+};
+
+} // namespace opt
+
+} // namespace lib
+
+} // namespace std
+} // namespace gil
+
+#endif // GIL_STD_OPT_HPP_
@@ -16,11 +16,11 @@ namespace str {
 
 namespace _impl_ {
 
-constexpr struct : local {
+constexpr struct : local, lib::opt::Scratch {
 } _str_idx_;
 static constexpr auto idx = global_(_str_idx_);
 
-constexpr struct : local {
+constexpr struct : local, lib::opt::Scratch {
 } _str_tmp_;
 static constexpr auto tmp = global_(_str_tmp_);
 
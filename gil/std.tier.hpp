@@ -0,0 +1,584 @@
+/** ********
+ * GIL Standard Library - Tiered Execution
+ *
+ * This header promotes loops the VM can run from template interpretation to a
+ * single constant evaluation, and writes their effects back to the runtime.
+ *
+ * Define `TIER` as 0 to interpret every loop step by step.
+ */
+
+#ifndef GIL_STD_TIER_HPP_
+#define GIL_STD_TIER_HPP_
+
+#include "std.impl.hpp"
+#include "std.vm.hpp"
+
+#ifndef TIER
+#define TIER 1
+#endif
+
+namespace gil {
+namespace std {
+
+namespace lib {
+
+namespace tier {
+
+namespace _impl_ {
+
+// Code the VM runs exactly as `Interpret` does: no calls, and only literals
+// the VM can represent.
+template <typename T> struct Pure {
+  static constexpr bool value = requires { vm::_impl_::ReprOf<T>::repr; } ||
+                                __is_enum(T) ||
+                                (__is_class(T) && __is_empty(T));
+};
+
+template <typename T> struct Pure<T const> : Pure<T> {};
+
+template <> struct Pure<void> {
+  static constexpr bool value = true;
+};
+
+template <unsigned n> struct Pure<detail::string::StringLiteral<n>> {
+  static constexpr bool value = true;
+};
+
+template <typename... Ts> struct Pure<bundle::Bundle<Ts...>> {
+  static constexpr bool value = (Pure<Ts>::value && ...);
+};
+
+template <typename Code> struct Pure<ir::IR<Code>> : Pure<Code> {};
+
+template <typename Name> struct Pure<code::Var<Name>> : Pure<Name> {};
+
+template <typename Name> struct Pure<code::Ref<Name>> : Pure<Name> {};
+
+template <typename Name> struct Pure<code::Drop<Name>> : Pure<Name> {};
+
+template <typename Var, typename Expr> struct Pure<code::Assign<Var, Expr>> {
+  static constexpr bool value = Pure<Var>::value && Pure<Expr>::value;
+};
+
+template <detail::string::StringLiteral name, typename... Args>
+struct Pure<code::Operator<name, Args...>> {
+  static constexpr auto op = vm::_impl_::operation_of(name);
+  static constexpr bool value = op != vm::Operation::Unsupported &&
+                                op != vm::Operation::Call &&
+                                (Pure<Args>::value && ...);
+};
+
+template <typename To, typename From> struct Pure<code::Cast<To, From>> {
+  static constexpr bool value = Pure<To>::value && Pure<From>::value;
+};
+
+template <typename Offset> struct Pure<code::Peek<Offset>> : Pure<Offset> {};
+
+template <typename Offset>
+struct Pure<code::Advance<Offset>> : Pure<Offset> {};
+
+template <typename Ch> struct Pure<code::PutC<Ch>> : Pure<Ch> {};
+
+template <typename T> struct Pure<code::ctrl::Break<T>> : Pure<T> {};
+
+template <typename... Code> struct Pure<code::ctrl::Block<Code...>> {
+  static constexpr bool value = (Pure<Code>::value && ...);
+};
+
+template <typename Cond, typename IfTrue, typename IfFalse>
+struct Pure<code::ctrl::IfBlock<Cond, IfTrue, IfFalse>> {
+  static constexpr bool value =
+      Pure<Cond>::value && Pure<IfTrue>::value && Pure<IfFalse>::value;
+};
+
+template <typename Code> struct Pure<code::ctrl::LoopBlock<Code>> : Pure<Code> {};
+
+// Whether a loop may run more than once. `block_`, `for_` and calls are loops
+// that end in an unconditional `break_`, which are cheaper to interpret than
+// to hand over.
+template <typename Code> struct Iterates {
+  static constexpr bool value = true;
+};
+
+template <typename Last> struct Ends {
+  static constexpr bool value = false;
+};
+
+template <typename T> struct Ends<code::ctrl::Break<T>> {
+  static constexpr bool value = true;
+};
+
+template <typename... Code>
+  requires(sizeof...(Code) > 0)
+struct Iterates<code::ctrl::Block<Code...>> {
+  static constexpr bool value = !Ends<detail::tfunc::_impl_::Element<
+      sizeof...(Code) - 1, Code...>>::value;
+};
+
+template <typename> struct Tag {};
+
+template <typename... Ts> struct Types : Tag<Ts>... {};
+
+template <typename Set, typename... Ts> struct Add {
+  using Result = Set;
+};
+
+template <typename... Ss, typename T, typename... Ts>
+struct Add<Types<Ss...>, T, Ts...> {
+  using Result = Add<
+      typename detail::tfunc::_impl_::Select<__is_base_of(Tag<T>, Types<Ss...>),
+                                             Types<Ss...>,
+                                             Types<Ss..., T>>::Result,
+      Ts...>::Result;
+};
+
+template <typename... Sets> struct Union {
+  using Result = Types<>;
+};
+
+template <typename Set, typename... Ts, typename... Sets>
+struct Union<Set, Types<Ts...>, Sets...> {
+  using Result = Union<typename Add<Set, Ts...>::Result, Sets...>::Result;
+};
+
+template <typename Set> struct Union<Set> {
+  using Result = Set;
+};
+
+// The enum and empty class types that values of type `T` may hold, which the
+// VM tells apart only by a tag numbering them.
+template <typename T> struct TypesOf {
+  using Result = detail::tfunc::_impl_::Select<
+      __is_enum(T) || (__is_class(T) && __is_empty(T)), Types<T>,
+      Types<>>::Result;
+};
+
+template <typename T> struct TypesOf<T const> : TypesOf<T> {};
+
+template <> struct TypesOf<void> {
+  using Result = Types<>;
+};
+
+template <template <typename...> typename X, typename... Ts>
+struct TypesOf<X<Ts...>> {
+  using Result = Union<Types<>, typename TypesOf<Ts>::Result...>::Result;
+};
+
+template <template <auto> typename X, auto x> struct TypesOf<X<x>> {
+  using Result = TypesOf<decltype(x)>::Result;
+};
+
+template <detail::string::StringLiteral name, typename... Args>
+struct TypesOf<code::Operator<name, Args...>> {
+  using Result = Union<Types<>, typename TypesOf<Args>::Result...>::Result;
+};
+
+template <auto key, typename V>
+struct TypesOf<detail::type::MapEntry<key, V>> {
+  using Result = Union<typename TypesOf<decltype(key)>::Result,
+                       typename TypesOf<V>::Result>::Result;
+};
+
+template <unsigned long long hash, typename Entries>
+struct TypesOf<detail::type::MapBucket<hash, Entries>> {
+  using Result = TypesOf<Entries>::Result;
+};
+
+// Every entry of a state.
+template <typename State> struct Entries {
+  using Result = detail::type::Pack<>;
+};
+
+template <typename... Slots>
+  requires(sizeof...(Slots) > 0)
+struct Entries<detail::type::Map<Slots...>> {
+  using Result = detail::tfunc::Join<detail::type::Pack<>,
+                                     typename Entries<Slots>::Result...>;
+};
+
+template <unsigned long long hash, typename... Es>
+struct Entries<detail::type::MapBucket<hash, detail::type::Pack<Es...>>> {
+  using Result = detail::type::Pack<Es...>;
+};
+
+template <vm::Repr repr, typename... Ts> struct Integral;
+
+template <vm::Repr repr, typename T, typename... Ts>
+struct Integral<repr, T, Ts...> : Integral<repr, Ts...> {};
+
+template <vm::Repr repr, typename T, typename... Ts>
+  requires(vm::_impl_::ReprOf<T>::repr == repr)
+struct Integral<repr, T, Ts...> {
+  using Result = T;
+};
+
+template <vm::Repr repr>
+using IntegralOf =
+    Integral<repr, bool, char, signed char, unsigned char, short,
+             unsigned short, int, unsigned, long, unsigned long, long long,
+             unsigned long long>::Result;
+
+// Converts state values for the VM, as `Lower` does for literals. Values
+// the VM has no counterpart for (like `fn_` lambdas) are carried as opaque
+// functions that no call matches, which remember their entry.
+struct Seed {
+  vm::Builder &builder;
+  vm::Machine &machine;
+  unsigned entry;
+
+  constexpr vm::Value operator()(none::None const &) const { return {}; }
+
+  template <typename... Ts>
+  constexpr vm::Value operator()(bundle::Bundle<Ts...> const &tuple) const {
+    return (*this)(tuple,
+                   detail::tfunc::_impl_::MakeIndices<sizeof...(Ts)>{});
+  }
+
+  template <typename... Ts, unsigned... is>
+  constexpr vm::Value operator()(bundle::Bundle<Ts...> const &tuple,
+                                 detail::tfunc::_impl_::Indices<is...>) const {
+    vm::Value const items[] = {(*this)(tuple.template get<is>())..., {}};
+    return machine.nodes.intern(vm::Kind::Tuple, items, sizeof...(Ts));
+  }
+
+  template <typename Name>
+  constexpr vm::Value operator()(code::Ref<Name> const &ref) const {
+    vm::Value const name[] = {(*this)(ref.name)};
+    return machine.nodes.intern(vm::Kind::Ref, name, 1);
+  }
+
+  // Mirrors `Machine::load`, which binds values through their variable.
+  template <typename Name, typename Value>
+  constexpr vm::Value operator()(code::BoundVar<Name, Value> const &bv) const {
+    auto const name = (*this)(bv.name);
+    auto value = (*this)(bv.value);
+    if (value.var || value.kind == vm::Kind::Bound) {
+      vm::Value const bound[] = {name, value};
+      return machine.nodes.intern(vm::Kind::Bound, bound, 2);
+    }
+    value.var = machine.vars.id_of(name) + 1;
+    return value;
+  }
+
+  template <unsigned n>
+  constexpr vm::Value
+  operator()(detail::string::StringLiteral<n> const &str) const {
+    return vm::_impl_::literal(builder, str);
+  }
+
+  template <typename T> constexpr vm::Value operator()(T const &x) const {
+    if constexpr (Pure<T>::value)
+      return vm::_impl_::literal(builder, x);
+    else
+      return {vm::Kind::Fn, vm::Repr::Int, 0, ~0ull, entry};
+  }
+};
+
+template <auto key, auto x>
+constexpr void seed(vm::Builder &builder, vm::Machine &machine,
+                    unsigned entry) {
+  Seed const convert{builder, machine, entry};
+  auto const name = convert(key);
+  auto const value = convert(x);
+  machine.vars.seed(machine.vars.id_of(name), value);
+}
+
+struct Term {
+  vm::Kind kind;
+  vm::Repr repr;
+  unsigned long long tag;
+  unsigned long long bits;
+  unsigned first;
+  unsigned count;
+};
+
+// A run's stores and its result, as trees of terms that `Decode` rebuilds.
+struct Report {
+  vm::Builder const &builder;
+  vm::Machine const &machine;
+  vm::Buffer<Term> terms;
+  vm::Buffer<unsigned> children;
+  vm::Buffer<char> chars;
+  vm::Buffer<unsigned> keys;
+  vm::Buffer<unsigned> values;
+
+  constexpr unsigned node(vm::Kind kind, vm::Value const *xs, unsigned n) {
+    auto const first = children.size;
+    terms.push({kind, vm::Repr::Int, 0, 0, first, n});
+    auto const term = terms.size - 1;
+    for (unsigned i = 0; i < n; ++i)
+      children.push(0);
+    for (unsigned i = 0; i < n; ++i) {
+      auto const child = add(xs[i]);
+      children[first + i] = child;
+    }
+    return term;
+  }
+
+  constexpr unsigned add(vm::Value value) {
+    if (value.var) {
+      auto inner = value;
+      inner.var = 0;
+      vm::Value const bound[] = {machine.vars.name(value.var - 1), inner};
+      return node(vm::Kind::Bound, bound, 2);
+    }
+    switch (value.kind) {
+    case vm::Kind::Tuple:
+    case vm::Kind::Ref:
+    case vm::Kind::Bound: {
+      auto const &n = machine.nodes.nodes[static_cast<unsigned>(value.bits)];
+      return node(value.kind, machine.nodes.items.data + n.first, n.count);
+    }
+    case vm::Kind::Str: {
+      terms.push({value.kind, value.repr, value.tag, value.bits, chars.size,
+                  static_cast<unsigned>(value.tag)});
+      for (unsigned i = 0; i < value.tag; ++i)
+        chars.push(builder.strings[static_cast<unsigned>(value.bits) + i]);
+      return terms.size - 1;
+    }
+    default:
+      terms.push({value.kind, value.repr, value.tag, value.bits, 0, 0});
+      return terms.size - 1;
+    }
+  }
+};
+
+struct Sizes {
+  unsigned terms;
+  unsigned children;
+  unsigned chars;
+  unsigned writes;
+  unsigned out;
+};
+
+template <Sizes sizes> struct Outcome {
+  Term terms[sizes.terms];
+  unsigned children[sizes.children ? sizes.children : 1];
+  char chars[sizes.chars ? sizes.chars : 1];
+  unsigned keys[sizes.writes ? sizes.writes : 1];
+  unsigned values[sizes.writes ? sizes.writes : 1];
+  char out[sizes.out ? sizes.out : 1];
+  unsigned cursor;
+  unsigned result;
+};
+
+template <typename Runtime, auto loop, typename Types, typename Entries>
+struct Tier;
+
+template <typename Runtime, auto loop, typename... Ts, auto... keys,
+          auto... xs>
+struct Tier<Runtime, loop, Types<Ts...>,
+            detail::type::Pack<detail::type::MapEntry<
+                keys, detail::type::Value<xs>>...>> {
+  template <unsigned i>
+  using Type = detail::tfunc::_impl_::Element<i, Ts...>;
+
+  template <unsigned i>
+  static constexpr auto opaque =
+      detail::tfunc::_impl_::Element<i, detail::tfunc::_impl_::Box<xs>...>::value;
+
+  // Runs the loop on the VM from the runtime's state, then hands the report
+  // of what it did to `sink`. Tags are numbered as `Types` lists them.
+  template <typename Sink> static constexpr auto evaluate(Sink sink) {
+    vm::Builder builder;
+    (builder.tag<Ts>(), ...);
+    vm::lower(builder, loop);
+    builder.emit(vm::Opcode::Halt, 0);
+
+    vm::Machine machine{detail::runtime::input.str,
+                        detail::runtime::input.size};
+    machine.cursor = Runtime::cursor;
+    constexpr void (*seeds[])(vm::Builder &, vm::Machine &, unsigned) = {
+        &_impl_::seed<keys, xs>..., nullptr};
+    for (unsigned i = 0; i < sizeof...(xs); ++i)
+      seeds[i](builder, machine, i);
+
+    machine.run(builder);
+
+    Report report{builder, machine, {}, {}, {}, {}, {}};
+    auto const &vars = machine.vars;
+    for (unsigned i = 0; i < vars.written.size; ++i) {
+      auto const slot = vars.written[i];
+      report.keys.push(report.add(vars.name(vars.writers[slot] - 1)));
+      report.values.push(report.add(vars.values[slot]));
+    }
+    auto const result = report.add(machine.stack.back());
+    return sink(report, machine, result);
+  }
+
+  static constexpr Sizes sizes =
+      evaluate([](Report const &report, vm::Machine const &machine, unsigned) {
+        return Sizes{report.terms.size, report.children.size,
+                     report.chars.size, report.keys.size, machine.out.size};
+      });
+
+  static constexpr auto outcome = evaluate(
+      [](Report const &report, vm::Machine const &machine, unsigned result) {
+        Outcome<sizes> outcome{};
+        for (unsigned i = 0; i < sizes.terms; ++i)
+          outcome.terms[i] = report.terms[i];
+        for (unsigned i = 0; i < sizes.children; ++i)
+          outcome.children[i] = report.children[i];
+        for (unsigned i = 0; i < sizes.chars; ++i)
+          outcome.chars[i] = report.chars[i];
+        for (unsigned i = 0; i < sizes.writes; ++i) {
+          outcome.keys[i] = report.keys[i];
+          outcome.values[i] = report.values[i];
+        }
+        for (unsigned i = 0; i < sizes.out; ++i)
+          outcome.out[i] = machine.out[i];
+        outcome.cursor = machine.cursor;
+        outcome.result = result;
+        return outcome;
+      });
+};
+
+template <typename Tier, unsigned i, vm::Kind = Tier::outcome.terms[i].kind>
+struct Decode {
+  static constexpr auto term = Tier::outcome.terms[i];
+  static constexpr auto value = [] {
+    if constexpr (term.tag == 0)
+      return static_cast<IntegralOf<term.repr>>(term.bits);
+    else {
+      using Enum = Tier::template Type<term.tag - 1>;
+      return static_cast<Enum>(static_cast<__underlying_type(Enum)>(term.bits));
+    }
+  }();
+};
+
+template <typename Tier, unsigned i> struct Decode<Tier, i, vm::Kind::None> {
+  static constexpr auto value = none::None{};
+};
+
+template <typename Tier, unsigned i> struct Decode<Tier, i, vm::Kind::Atom> {
+  static constexpr auto value =
+      typename Tier::template Type<Tier::outcome.terms[i].tag - 1>{};
+};
+
+template <typename Tier, unsigned i> struct Decode<Tier, i, vm::Kind::Tuple> {
+  static constexpr auto term = Tier::outcome.terms[i];
+
+  // Spelled out, since deduction would unwrap a tuple holding one tuple.
+  template <typename... Ts>
+  static constexpr auto make(Ts const &...items) noexcept {
+    return bundle::Bundle<Ts...>{items...};
+  }
+
+  template <unsigned... js>
+  static constexpr auto decode(detail::tfunc::_impl_::Indices<js...>) {
+    return make(
+        Decode<Tier, Tier::outcome.children[term.first + js]>::value...);
+  }
+
+  static constexpr auto value =
+      decode(detail::tfunc::_impl_::MakeIndices<term.count>{});
+};
+
+template <typename Tier, unsigned i> struct Decode<Tier, i, vm::Kind::Ref> {
+  static constexpr auto value = code::Ref{
+      Decode<Tier, Tier::outcome.children[Tier::outcome.terms[i].first]>::value};
+};
+
+template <typename Tier, unsigned i> struct Decode<Tier, i, vm::Kind::Bound> {
+  static constexpr auto first = Tier::outcome.terms[i].first;
+  static constexpr auto value = code::BoundVar{
+      Decode<Tier, Tier::outcome.children[first]>::value,
+      Decode<Tier, Tier::outcome.children[first + 1]>::value};
+};
+
+template <typename Tier, unsigned i> struct Decode<Tier, i, vm::Kind::Str> {
+  static constexpr auto term = Tier::outcome.terms[i];
+  static constexpr auto value = detail::string::StringLiteral<term.count>(
+      Tier::outcome.chars + term.first);
+};
+
+template <typename Tier, unsigned i> struct Decode<Tier, i, vm::Kind::Fn> {
+  static constexpr auto value =
+      Tier::template opaque<Tier::outcome.terms[i].bits>;
+};
+
+// Writes back a store. Storing none is written back as a removal, since a
+// dropped variable reads as none in the VM.
+template <typename Tier, unsigned w,
+          vm::Kind = Tier::outcome.terms[Tier::outcome.values[w]].kind>
+struct Store {
+  using Result = detail::exec::Set<
+      Decode<Tier, Tier::outcome.keys[w]>::value,
+      detail::expr::val<Decode<Tier, Tier::outcome.values[w]>::value>>;
+};
+
+template <typename Tier, unsigned w> struct Store<Tier, w, vm::Kind::None> {
+  using Result =
+      detail::exec::Unset<Decode<Tier, Tier::outcome.keys[w]>::value>;
+};
+
+// Marks a promoted loop in the state, counting its runs, under `DEBUG`.
+template <auto loop> struct Promoted {
+  constexpr bool operator==(Promoted const &) const = default;
+};
+
+template <typename Runtime, auto loop> struct Promote {
+  using Tier = _impl_::Tier<
+      Runtime, loop,
+      typename Union<typename TypesOf<decltype(loop)>::Result,
+                     typename TypesOf<typename Runtime::State>::Result>::Result,
+      typename Entries<typename Runtime::State>::Result>;
+
+  static constexpr auto &outcome = Tier::outcome;
+
+  template <unsigned... ws, unsigned... cs>
+  static auto apply(detail::tfunc::_impl_::Indices<ws...>,
+                    detail::tfunc::_impl_::Indices<cs...>)
+      -> typename Runtime::template Run<
+          typename Store<Tier, ws>::Result...,
+#if DEBUG
+          detail::exec::Set<
+              Promoted<loop>{},
+              detail::expr::val<1 + detail::tfunc::GetItem<
+                                        typename Runtime::State,
+                                        Promoted<loop>{},
+                                        detail::type::Value<0u>>::value>>,
+#endif
+          detail::exec::Put<detail::expr::val<outcome.out[cs]>>...,
+          detail::exec::Advance<
+              detail::expr::val<outcome.cursor - Runtime::cursor>>>;
+
+  using Effect = decltype(apply(
+      detail::tfunc::_impl_::MakeIndices<Tier::sizes.writes>{},
+      detail::tfunc::_impl_::MakeIndices<Tier::sizes.out>{}));
+  static constexpr auto retval = Decode<Tier, outcome.result>::value;
+};
+
+} // namespace _impl_
+
+#if TIER
+template <typename Code, code::ctrl::LoopBlock<Code> loop>
+struct Promotes<loop> {
+  static constexpr bool value = _impl_::Pure<decltype(loop)>::value &&
+                                _impl_::Iterates<Code>::value;
+};
+#endif
+
+} // namespace tier
+
+namespace interpret {
+
+#if TIER
+template <typename Runtime, typename Code, code::ctrl::LoopBlock<Code> loop>
+  requires(tier::Promotes<loop>::value)
+struct Interpret<Runtime, loop> {
+  using Promote = tier::_impl_::Promote<Runtime, loop>;
+
+  using Effect = Promote::Effect;
+  static constexpr auto retval = Promote::retval;
+};
+#endif
+
+} // namespace interpret
+
+} // namespace lib
+
+} // namespace std
+} // namespace gil
+
+#endif // GIL_STD_TIER_HPP_
@@ -0,0 +1,1359 @@
+/** ********
+ * GIL Standard Library - Virtual Machine
+ *
+ * This header lowers the interpreter's code tree into a flat instruction
+ * array, and runs it over value-based state inside a single constant
+ * evaluation.
+ */
+
+#ifndef GIL_STD_VM_HPP_
+#define GIL_STD_VM_HPP_
+
+#include "std.impl.hpp"
+
+namespace gil {
+namespace std {
+
+namespace lib {
+
+namespace vm {
+
+// Not constexpr: reaching this during constant evaluation is a compile error
+// that names the unsupported operation.
+[[noreturn]] inline void fault(char const *) noexcept { __builtin_trap(); }
+
+template <typename T> struct Buffer {
+  T *data = nullptr;
+  unsigned size = 0;
+  unsigned capacity = 0;
+
+  constexpr Buffer() noexcept = default;
+  Buffer(Buffer const &) = delete;
+  Buffer &operator=(Buffer const &) = delete;
+  constexpr ~Buffer() { delete[] data; }
+
+  constexpr void reserve(unsigned n) {
+    if (n <= capacity)
+      return;
+    T *grown = new T[n];
+    for (unsigned i = 0; i < size; ++i)
+      grown[i] = data[i];
+    delete[] data;
+    data = grown;
+    capacity = n;
+  }
+
+  constexpr T &push(T const &x) {
+    if (size == capacity)
+      reserve(capacity ? 2 * capacity : 16);
+    return data[size++] = x;
+  }
+
+  constexpr T pop() noexcept { return data[--size]; }
+  constexpr T &back() noexcept { return data[size - 1]; }
+  constexpr T &operator[](unsigned i) noexcept { return data[i]; }
+  constexpr T const &operator[](unsigned i) const noexcept { return data[i]; }
+};
+
+enum class Kind : unsigned char { None, Int, Atom, Tuple, Ref, Bound, Fn, Str };
+
+enum class Repr : unsigned char {
+  Bool,
+  Char,
+  SChar,
+  UChar,
+  Short,
+  UShort,
+  Int,
+  UInt,
+  Long,
+  ULong,
+  LongLong,
+  ULongLong,
+};
+
+// A value of the abstract machine. Integers keep their C++ type (`repr`, and
+// `tag` for enums), atoms are the `local` name types, and tuples and
+// references are interned nodes, so that equal names share an id. A value
+// read from a variable also records the variable (`var` is its id plus one);
+// only a variable holding another bound variable needs a `Bound` node.
+struct Value {
+  Kind kind = Kind::None;
+  Repr repr = Repr::Int;
+  unsigned var = 0;
+  unsigned long long tag = 0;
+  unsigned long long bits = 0;
+
+  constexpr bool operator==(Value const &) const noexcept = default;
+};
+
+namespace _impl_ {
+
+template <typename> struct ReprOf;
+
+template <> struct ReprOf<bool> {
+  static constexpr auto repr = Repr::Bool;
+};
+template <> struct ReprOf<char> {
+  static constexpr auto repr = Repr::Char;
+};
+template <> struct ReprOf<signed char> {
+  static constexpr auto repr = Repr::SChar;
+};
+template <> struct ReprOf<unsigned char> {
+  static constexpr auto repr = Repr::UChar;
+};
+template <> struct ReprOf<short> {
+  static constexpr auto repr = Repr::Short;
+};
+template <> struct ReprOf<unsigned short> {
+  static constexpr auto repr = Repr::UShort;
+};
+template <> struct ReprOf<int> {
+  static constexpr auto repr = Repr::Int;
+};
+template <> struct ReprOf<unsigned> {
+  static constexpr auto repr = Repr::UInt;
+};
+template <> struct ReprOf<long> {
+  static constexpr auto repr = Repr::Long;
+};
+template <> struct ReprOf<unsigned long> {
+  static constexpr auto repr = Repr::ULong;
+};
+template <> struct ReprOf<long long> {
+  static constexpr auto repr = Repr::LongLong;
+};
+template <> struct ReprOf<unsigned long long> {
+  static constexpr auto repr = Repr::ULongLong;
+};
+
+constexpr unsigned width(Repr repr) noexcept {
+  switch (repr) {
+  case Repr::Bool:
+    return 1;
+  case Repr::Char:
+  case Repr::SChar:
+  case Repr::UChar:
+    return 8 * sizeof(char);
+  case Repr::Short:
+  case Repr::UShort:
+    return 8 * sizeof(short);
+  case Repr::Int:
+  case Repr::UInt:
+    return 8 * sizeof(int);
+  case Repr::Long:
+  case Repr::ULong:
+    return 8 * sizeof(long);
+  default:
+    return 8 * sizeof(long long);
+  }
+}
+
+constexpr bool is_signed(Repr repr) noexcept {
+  switch (repr) {
+  case Repr::Char:
+    return static_cast<char>(-1) < 0;
+  case Repr::SChar:
+  case Repr::Short:
+  case Repr::Int:
+  case Repr::Long:
+  case Repr::LongLong:
+    return true;
+  default:
+    return false;
+  }
+}
+
+constexpr unsigned rank(Repr repr) noexcept {
+  switch (repr) {
+  case Repr::Long:
+  case Repr::ULong:
+    return 1;
+  case Repr::LongLong:
+  case Repr::ULongLong:
+    return 2;
+  default:
+    return 0;
+  }
+}
+
+constexpr Repr as_unsigned(Repr repr) noexcept {
+  switch (repr) {
+  case Repr::Int:
+    return Repr::UInt;
+  case Repr::Long:
+    return Repr::ULong;
+  case Repr::LongLong:
+    return Repr::ULongLong;
+  default:
+    return repr;
+  }
+}
+
+constexpr Repr promote(Repr repr) noexcept {
+  return width(repr) < width(Repr::Int) ? Repr::Int : repr;
+}
+
+// The usual arithmetic conversions over promoted operands.
+constexpr Repr common(Repr lhs, Repr rhs) noexcept {
+  lhs = promote(lhs);
+  rhs = promote(rhs);
+  if (lhs == rhs)
+    return lhs;
+  if (is_signed(lhs) == is_signed(rhs))
+    return rank(lhs) < rank(rhs) ? rhs : lhs;
+  auto const s = is_signed(lhs) ? lhs : rhs;
+  auto const u = is_signed(lhs) ? rhs : lhs;
+  if (rank(u) >= rank(s))
+    return u;
+  if (width(s) > width(u))
+    return s;
+  return as_unsigned(s);
+}
+
+constexpr __int128 numeric(Value value) noexcept {
+  if (is_signed(value.repr))
+    return static_cast<long long>(value.bits);
+  return static_cast<__int128>(value.bits);
+}
+
+constexpr Value integer(Repr repr, __int128 x,
+                        unsigned long long tag = 0) noexcept {
+  auto const bits = width(repr);
+  unsigned long long raw = static_cast<unsigned long long>(x);
+  if (repr == Repr::Bool)
+    raw = x != 0;
+  else if (bits < 64) {
+    raw &= (1ull << bits) - 1;
+    if (is_signed(repr) && (raw >> (bits - 1)) & 1)
+      raw |= ~((1ull << bits) - 1);
+  }
+  return {Kind::Int, repr, 0, tag, raw};
+}
+
+// Like `integer`, but signed overflow is an error, as in a constant
+// expression.
+constexpr Value exact(Repr repr, __int128 x) noexcept {
+  if (is_signed(repr)) {
+    auto const bound = static_cast<__int128>(1) << (width(repr) - 1);
+    if (x < -bound || x >= bound)
+      fault("signed overflow");
+  }
+  return integer(repr, x);
+}
+
+constexpr Value boolean(bool x) noexcept { return integer(Repr::Bool, x); }
+
+constexpr unsigned long long mix(unsigned long long hash,
+                                 unsigned long long x) noexcept {
+  hash ^= x + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+  return hash;
+}
+
+// Spreads a combined hash over all bits, since tables index by its low bits.
+constexpr unsigned long long finish(unsigned long long hash) noexcept {
+  hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ull;
+  hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebull;
+  return hash ^ (hash >> 31);
+}
+
+constexpr unsigned long long hash_of(Value value) noexcept {
+  auto const head = static_cast<unsigned long long>(value.kind) << 40 |
+                    static_cast<unsigned long long>(value.repr) << 32 |
+                    value.var;
+  return finish(mix(mix(head, value.tag), value.bits));
+}
+
+} // namespace _impl_
+
+enum class Opcode : unsigned char {
+  Push,
+  Pop,
+  Slide,
+  Tuple,
+  Load,
+  Ref,
+  Store,
+  Drop,
+  Unary,
+  Binary,
+  Update,
+  Index,
+  Call,
+  Arg,
+  Return,
+  Cast,
+  Truth,
+  Peek,
+  Advance,
+  GetC,
+  PutC,
+  Jump,
+  JumpUnless,
+  Halt,
+};
+
+enum class Operation : unsigned char {
+  Pos,
+  Neg,
+  Deref,
+  Compl,
+  AddressOf,
+  Not,
+  PreInc,
+  PreDec,
+  PostInc,
+  PostDec,
+  Add,
+  Sub,
+  Mul,
+  Div,
+  Mod,
+  Xor,
+  And,
+  Or,
+  Lt,
+  Gt,
+  Shl,
+  Shr,
+  Eq,
+  Ne,
+  Le,
+  Ge,
+  LogicalAnd,
+  LogicalOr,
+  Assign,
+  Call,
+  Index,
+  Unsupported,
+};
+
+struct Instruction {
+  Opcode op;
+  unsigned a = 0;
+  unsigned b = 0;
+};
+
+namespace _impl_ {
+
+template <unsigned n>
+constexpr bool spelled(detail::string::StringLiteral<n> const &name,
+                       char const *spelling) noexcept {
+  for (unsigned i = 0; i < n; ++i)
+    if (spelling[i] != name[i])
+      return false;
+  return spelling[n] == '\0';
+}
+
+// Maps the spelling used by `code::Operator` to an operation. Compound
+// assignments map to their underlying binary operation.
+template <unsigned n>
+constexpr Operation operation_of(
+    detail::string::StringLiteral<n> const &name) noexcept {
+  constexpr struct {
+    char const *spelling;
+    Operation op;
+  } table[] = {
+      {"+#", Operation::Pos},       {"-#", Operation::Neg},
+      {"*#", Operation::Deref},     {"~#", Operation::Compl},
+      {"&#", Operation::AddressOf}, {"!#", Operation::Not},
+      {"++#", Operation::PreInc},   {"--#", Operation::PreDec},
+      {"#++", Operation::PostInc},  {"#--", Operation::PostDec},
+      {"+", Operation::Add},        {"-", Operation::Sub},
+      {"*", Operation::Mul},        {"/", Operation::Div},
+      {"%", Operation::Mod},        {"^", Operation::Xor},
+      {"&", Operation::And},        {"|", Operation::Or},
+      {"<", Operation::Lt},         {">", Operation::Gt},
+      {"<<", Operation::Shl},       {">>", Operation::Shr},
+      {"==", Operation::Eq},        {"!=", Operation::Ne},
+      {"<=", Operation::Le},        {">=", Operation::Ge},
+      {"&&", Operation::LogicalAnd}, {"||", Operation::LogicalOr},
+      {"=", Operation::Assign},     {"()", Operation::Call},
+      {"[]", Operation::Index},     {"+=", Operation::Add},
+      {"-=", Operation::Sub},       {"*=", Operation::Mul},
+      {"/=", Operation::Div},       {"%=", Operation::Mod},
+      {"^=", Operation::Xor},       {"&=", Operation::And},
+      {"|=", Operation::Or},        {"<<=", Operation::Shl},
+      {">>=", Operation::Shr},
+  };
+  for (auto const &entry : table)
+    if (spelled(name, entry.spelling))
+      return entry.op;
+  return Operation::Unsupported;
+}
+
+template <unsigned n>
+constexpr bool is_update(
+    detail::string::StringLiteral<n> const &name) noexcept {
+  return n >= 2 && name[n - 1] == '=' && !spelled(name, "==") &&
+         !spelled(name, "!=") && !spelled(name, "<=") && !spelled(name, ">=");
+}
+
+template <typename T> struct TypeId {
+  static constexpr char id = 0;
+};
+
+template <int> struct Arg {};
+
+struct Loop {
+  unsigned head;
+  unsigned depth;
+  unsigned breaks;
+};
+
+} // namespace _impl_
+
+// Collects the instructions, constants and string literals of a program.
+// `depth` tracks the static stack height, so that `break_` and `continue_`
+// know how many temporaries to drop on their way out of a loop.
+struct Builder {
+  Buffer<Instruction> code;
+  Buffer<Value> constants;
+  Buffer<char> strings;
+  Buffer<void const *> types;
+  Buffer<_impl_::Loop> loops;
+  Buffer<unsigned> breaks;
+  unsigned depth = 0;
+
+  constexpr unsigned emit(Opcode op, int effect, unsigned a = 0,
+                          unsigned b = 0) {
+    depth += effect;
+    code.push({op, a, b});
+    return code.size - 1;
+  }
+
+  constexpr void patch(unsigned at) noexcept { code[at].a = code.size; }
+
+  template <typename T> constexpr unsigned long long tag() {
+    void const *id = &_impl_::TypeId<T>::id;
+    for (unsigned i = 0; i < types.size; ++i)
+      if (types[i] == id)
+        return i + 1;
+    types.push(id);
+    return types.size;
+  }
+
+  constexpr void push(Value value) {
+    constants.push(value);
+    emit(Opcode::Push, 1, constants.size - 1);
+  }
+};
+
+template <typename Code> struct Lower;
+
+template <typename Code> constexpr void lower(Builder &builder, Code const &code) {
+  Lower<Code>::emit(builder, code);
+}
+
+namespace _impl_ {
+
+template <typename T> constexpr Value literal(Builder &builder, T const &x) {
+  if constexpr (requires { ReprOf<T>::repr; })
+    return integer(ReprOf<T>::repr, x);
+  else if constexpr (__is_enum(T))
+    return integer(ReprOf<__underlying_type(T)>::repr,
+                   static_cast<__underlying_type(T)>(x),
+                   builder.template tag<T>());
+  else if constexpr (__is_empty(T))
+    return {Kind::Atom, Repr::Int, 0, builder.template tag<T>(), 0};
+  else
+    static_assert(false && sizeof(T), "Value not supported by the VM");
+}
+
+template <unsigned n>
+constexpr Value literal(Builder &builder,
+                        detail::string::StringLiteral<n> const &str) {
+  Value value{Kind::Str, Repr::Char, 0, n, builder.strings.size};
+  for (unsigned i = 0; i <= n; ++i)
+    builder.strings.push(str.str[i]);
+  return value;
+}
+
+constexpr Value literal(Builder &, none::None const &) { return {}; }
+
+template <typename... Code, unsigned... is>
+constexpr void lower_all(Builder &builder, bundle::Bundle<Code...> const &code,
+                         detail::tfunc::_impl_::Indices<is...>) {
+  (lower(builder, code.template get<is>()), ...);
+}
+
+template <typename... Code>
+constexpr void lower_all(Builder &builder,
+                         bundle::Bundle<Code...> const &code) {
+  lower_all(builder, code,
+            detail::tfunc::_impl_::MakeIndices<sizeof...(Code)>{});
+}
+
+template <typename Fn, unsigned... is>
+constexpr auto apply(Fn const &fn, detail::tfunc::_impl_::Indices<is...>) {
+  return fn(Arg<is>{}...);
+}
+
+template <typename> struct Arity;
+
+template <typename... Ts> struct Arity<bundle::Bundle<Ts...>> {
+  static constexpr unsigned value = sizeof...(Ts);
+};
+
+} // namespace _impl_
+
+// Literals, including `fn_` lambdas, whose bodies are emitted out of line
+// and called through `Call`/`Return`.
+template <typename Code> struct Lower {
+  static constexpr void emit(Builder &builder, Code const &code) {
+    if constexpr (requires {
+                    code.args;
+                    code.body;
+                  }) {
+      constexpr unsigned arity =
+          _impl_::Arity<decltype(code.args)>::value;
+      auto const skip = builder.emit(Opcode::Jump, 0);
+      auto const entry = builder.code.size;
+      auto const depth = builder.depth;
+      auto const loops = builder.loops.size;
+      builder.depth = 0;
+      lower(builder, _impl_::apply(
+                         code, detail::tfunc::_impl_::MakeIndices<arity>{}));
+      builder.emit(Opcode::Return, -1);
+      builder.depth = depth;
+      builder.loops.size = loops;
+      builder.patch(skip);
+      builder.push({Kind::Fn, Repr::Int, 0, arity, entry});
+    } else {
+      builder.push(_impl_::literal(builder, code));
+    }
+  }
+};
+
+template <int i> struct Lower<_impl_::Arg<i>> {
+  static constexpr void emit(Builder &builder, _impl_::Arg<i> const &) {
+    builder.emit(Opcode::Arg, 1, i);
+  }
+};
+
+template <typename Code> struct Lower<ir::IR<Code>> {
+  static constexpr void emit(Builder &builder, ir::IR<Code> const &ir) {
+    lower(builder, ir.code);
+  }
+};
+
+template <typename... Code> struct Lower<bundle::Bundle<Code...>> {
+  static constexpr void emit(Builder &builder,
+                             bundle::Bundle<Code...> const &code) {
+    _impl_::lower_all(builder, code);
+    builder.emit(Opcode::Tuple, 1 - static_cast<int>(sizeof...(Code)),
+                 sizeof...(Code));
+  }
+};
+
+template <typename Name> struct Lower<code::Var<Name>> {
+  static constexpr void emit(Builder &builder, code::Var<Name> const &var) {
+    lower(builder, var.name);
+    builder.emit(Opcode::Load, 0);
+  }
+};
+
+template <typename Name> struct Lower<code::Ref<Name>> {
+  static constexpr void emit(Builder &builder, code::Ref<Name> const &ref) {
+    lower(builder, ref.name);
+    builder.emit(Opcode::Ref, 0);
+  }
+};
+
+template <typename Name> struct Lower<code::Drop<Name>> {
+  static constexpr void emit(Builder &builder, code::Drop<Name> const &drop) {
+    lower(builder, drop.name);
+    builder.emit(Opcode::Drop, 0);
+  }
+};
+
+template <typename Var, typename Expr> struct Lower<code::Assign<Var, Expr>> {
+  static constexpr void emit(Builder &builder,
+                             code::Assign<Var, Expr> const &assign) {
+    lower(builder, assign.var);
+    lower(builder, assign.expr);
+    builder.emit(Opcode::Store, -1);
+  }
+};
+
+template <detail::string::StringLiteral name, typename... Args>
+struct Lower<code::Operator<name, Args...>> {
+  static constexpr auto op = _impl_::operation_of(name);
+  static constexpr int arity = sizeof...(Args);
+
+  static constexpr void emit(Builder &builder,
+                             code::Operator<name, Args...> const &code) {
+    static_assert(op != Operation::Unsupported,
+                  "Operator not supported by the VM");
+    if constexpr (op == Operation::LogicalAnd ||
+                  op == Operation::LogicalOr) {
+      // `a && b` is `a ? bool(b) : false`, and `a || b` is
+      // `a ? true : bool(b)`.
+      lower(builder, code.args.template get<0>());
+      auto const other = builder.emit(Opcode::JumpUnless, -1);
+      if constexpr (op == Operation::LogicalAnd) {
+        lower(builder, code.args.template get<1>());
+        builder.emit(Opcode::Truth, 0);
+      } else {
+        builder.push(_impl_::boolean(true));
+      }
+      auto const done = builder.emit(Opcode::Jump, -1);
+      builder.patch(other);
+      if constexpr (op == Operation::LogicalAnd) {
+        builder.push(_impl_::boolean(false));
+      } else {
+        lower(builder, code.args.template get<1>());
+        builder.emit(Opcode::Truth, 0);
+      }
+      builder.patch(done);
+    } else {
+      _impl_::lower_all(builder, code.args);
+      if constexpr (op == Operation::Call)
+        builder.emit(Opcode::Call, 1 - arity, arity - 1);
+      else if constexpr (op == Operation::Index)
+        builder.emit(Opcode::Index, 1 - arity, arity - 1);
+      else if constexpr (op == Operation::Assign)
+        builder.emit(Opcode::Store, -1);
+      else if constexpr (_impl_::is_update(name))
+        builder.emit(Opcode::Update, -1, static_cast<unsigned>(op));
+      else if constexpr (arity == 1)
+        builder.emit(Opcode::Unary, 0, static_cast<unsigned>(op));
+      else
+        builder.emit(Opcode::Binary, -1, static_cast<unsigned>(op));
+    }
+  }
+};
+
+template <typename To, typename From> struct Lower<code::Cast<To, From>> {
+  static constexpr void emit(Builder &builder,
+                             code::Cast<To, From> const &cast) {
+    lower(builder, cast.from);
+    auto const type = _impl_::literal(builder, To{});
+    builder.emit(Opcode::Cast, 0, static_cast<unsigned>(type.repr),
+                 static_cast<unsigned>(type.tag));
+  }
+};
+
+template <typename Offset> struct Lower<code::Peek<Offset>> {
+  static constexpr void emit(Builder &builder,
+                             code::Peek<Offset> const &peek) {
+    lower(builder, peek.offset);
+    builder.emit(Opcode::Peek, 0);
+  }
+};
+
+template <typename Offset> struct Lower<code::Advance<Offset>> {
+  static constexpr void emit(Builder &builder,
+                             code::Advance<Offset> const &advance) {
+    lower(builder, advance.offset);
+    builder.emit(Opcode::Advance, 0);
+  }
+};
+
+template <> struct Lower<code::GetC> {
+  static constexpr void emit(Builder &builder, code::GetC const &) {
+    builder.emit(Opcode::GetC, 1);
+  }
+};
+
+template <typename Ch> struct Lower<code::PutC<Ch>> {
+  static constexpr void emit(Builder &builder, code::PutC<Ch> const &putc) {
+    lower(builder, putc.ch);
+    builder.emit(Opcode::PutC, 0);
+  }
+};
+
+template <typename... Code> struct Lower<code::ctrl::Block<Code...>> {
+  static constexpr void emit(Builder &builder,
+                             code::ctrl::Block<Code...> const &block) {
+    if constexpr (sizeof...(Code) == 0) {
+      builder.push({});
+    } else {
+      emit(builder, block,
+           detail::tfunc::_impl_::MakeIndices<sizeof...(Code)>{});
+    }
+  }
+
+  template <unsigned... is>
+  static constexpr void emit(Builder &builder,
+                             code::ctrl::Block<Code...> const &block,
+                             detail::tfunc::_impl_::Indices<is...>) {
+    ((lower(builder, block.code.template get<is>()),
+      is + 1 < sizeof...(Code) ? void(builder.emit(Opcode::Pop, -1))
+                               : void()),
+     ...);
+  }
+};
+
+template <typename Cond, typename IfTrue, typename IfFalse>
+struct Lower<code::ctrl::IfBlock<Cond, IfTrue, IfFalse>> {
+  static constexpr void
+  emit(Builder &builder,
+       code::ctrl::IfBlock<Cond, IfTrue, IfFalse> const &if_) {
+    lower(builder, if_.cond);
+    auto const otherwise = builder.emit(Opcode::JumpUnless, -1);
+    lower(builder, if_.iftrue);
+    auto const done = builder.emit(Opcode::Jump, -1);
+    builder.patch(otherwise);
+    lower(builder, if_.iffalse);
+    builder.patch(done);
+  }
+};
+
+template <typename Code> struct Lower<code::ctrl::LoopBlock<Code>> {
+  static constexpr void emit(Builder &builder,
+                             code::ctrl::LoopBlock<Code> const &loop) {
+    auto const head = builder.code.size;
+    builder.loops.push({head, builder.depth, builder.breaks.size});
+    lower(builder, loop.code);
+    builder.emit(Opcode::Pop, -1);
+    builder.emit(Opcode::Jump, 0, head);
+    auto const frame = builder.loops.pop();
+    while (builder.breaks.size > frame.breaks)
+      builder.patch(builder.breaks.pop());
+    builder.depth = frame.depth + 1;
+  }
+};
+
+template <typename T> struct Lower<code::ctrl::Break<T>> {
+  static constexpr void emit(Builder &builder,
+                             code::ctrl::Break<T> const &break_) {
+    auto const loop = builder.loops.back();
+    auto const depth = builder.depth;
+    lower(builder, break_.result);
+    builder.emit(Opcode::Slide, 0, builder.depth - loop.depth - 1);
+    builder.breaks.push(builder.emit(Opcode::Jump, 0));
+    builder.depth = depth + 1;
+  }
+};
+
+template <> struct Lower<code::ctrl::Continue> {
+  static constexpr void emit(Builder &builder,
+                             code::ctrl::Continue const &) {
+    auto const loop = builder.loops.back();
+    auto const depth = builder.depth;
+    builder.push({});
+    builder.emit(Opcode::Slide, 0, builder.depth - loop.depth - 1);
+    builder.emit(Opcode::Pop, 0);
+    builder.emit(Opcode::Jump, 0, loop.head);
+    builder.depth = depth + 1;
+  }
+};
+
+template <unsigned ninstr, unsigned nconst, unsigned nchar> struct Program {
+  Instruction code[ninstr];
+  Value constants[nconst ? nconst : 1];
+  char strings[nchar ? nchar : 1];
+};
+
+namespace _impl_ {
+
+template <auto code> constexpr void lower_program(Builder &builder) {
+  lower(builder, code);
+  builder.emit(Opcode::Pop, -1);
+  builder.emit(Opcode::Halt, 0);
+}
+
+struct Sizes {
+  unsigned code;
+  unsigned constants;
+  unsigned strings;
+};
+
+template <auto code>
+static constexpr auto sizes = [] {
+  Builder builder;
+  lower_program<code>(builder);
+  return Sizes{builder.code.size, builder.constants.size,
+               builder.strings.size};
+}();
+
+} // namespace _impl_
+
+template <auto code>
+static constexpr auto compile = [] {
+  constexpr auto sizes = _impl_::sizes<code>;
+  Builder builder;
+  _impl_::lower_program<code>(builder);
+  Program<sizes.code, sizes.constants, sizes.strings> program{};
+  for (unsigned i = 0; i < sizes.code; ++i)
+    program.code[i] = builder.code[i];
+  for (unsigned i = 0; i < sizes.constants; ++i)
+    program.constants[i] = builder.constants[i];
+  for (unsigned i = 0; i < sizes.strings; ++i)
+    program.strings[i] = builder.strings[i];
+  return program;
+}();
+
+namespace _impl_ {
+
+struct Node {
+  Kind kind;
+  unsigned first;
+  unsigned count;
+};
+
+struct Frame {
+  unsigned ret;
+  unsigned base;
+};
+
+// Open-addressing hash set of interned nodes, keyed on their children.
+struct Interner {
+  Buffer<Node> nodes;
+  Buffer<Value> items;
+  Buffer<unsigned> table;
+
+  constexpr unsigned long long hash_of(Kind kind, Value const *xs,
+                                       unsigned n) const noexcept {
+    auto hash = mix(static_cast<unsigned long long>(kind), n);
+    for (unsigned i = 0; i < n; ++i)
+      hash = mix(hash, _impl_::hash_of(xs[i]));
+    return finish(hash);
+  }
+
+  constexpr bool matches(unsigned id, Kind kind, Value const *xs,
+                         unsigned n) const noexcept {
+    auto const &node = nodes[id];
+    if (node.kind != kind || node.count != n)
+      return false;
+    for (unsigned i = 0; i < n; ++i)
+      if (!(items[node.first + i] == xs[i]))
+        return false;
+    return true;
+  }
+
+  constexpr void rehash() {
+    Buffer<unsigned> grown;
+    grown.reserve(table.size ? 2 * table.size : 64);
+    grown.size = grown.capacity;
+    for (unsigned i = 0; i < grown.size; ++i)
+      grown[i] = 0;
+    for (unsigned id = 0; id < nodes.size; ++id) {
+      auto const &node = nodes[id];
+      auto slot = hash_of(node.kind, items.data + node.first, node.count) &
+                  (grown.size - 1);
+      while (grown[slot])
+        slot = (slot + 1) & (grown.size - 1);
+      grown[slot] = id + 1;
+    }
+    delete[] table.data;
+    table.data = grown.data;
+    table.size = grown.size;
+    table.capacity = grown.capacity;
+    grown.data = nullptr;
+  }
+
+  constexpr Value intern(Kind kind, Value const *xs, unsigned n) {
+    if (2 * (nodes.size + 1) > table.size)
+      rehash();
+    auto slot = hash_of(kind, xs, n) & (table.size - 1);
+    for (; table[slot]; slot = (slot + 1) & (table.size - 1))
+      if (matches(table[slot] - 1, kind, xs, n))
+        return {kind, Repr::Int, 0, 0, table[slot] - 1};
+    table[slot] = nodes.size + 1;
+    nodes.push({kind, items.size, n});
+    for (unsigned i = 0; i < n; ++i)
+      items.push(xs[i]);
+    return {kind, Repr::Int, 0, 0, nodes.size - 1};
+  }
+
+  constexpr Value child(Value value, unsigned i) const noexcept {
+    return items[nodes[value.bits].first + i];
+  }
+};
+
+// Open-addressing index that numbers distinct values densely.
+struct Index {
+  Buffer<Value> keys;
+  Buffer<unsigned> table;
+
+  constexpr void rehash() {
+    Buffer<unsigned> grown;
+    grown.reserve(table.size ? 2 * table.size : 64);
+    grown.size = grown.capacity;
+    for (unsigned i = 0; i < grown.size; ++i)
+      grown[i] = 0;
+    for (unsigned id = 0; id < keys.size; ++id) {
+      auto slot = hash_of(keys[id]) & (grown.size - 1);
+      while (grown[slot])
+        slot = (slot + 1) & (grown.size - 1);
+      grown[slot] = id + 1;
+    }
+    delete[] table.data;
+    table.data = grown.data;
+    table.size = grown.size;
+    table.capacity = grown.capacity;
+    grown.data = nullptr;
+  }
+
+  constexpr unsigned id_of(Value key) {
+    if (2 * (keys.size + 1) > table.size)
+      rehash();
+    auto slot = hash_of(key) & (table.size - 1);
+    for (; table[slot]; slot = (slot + 1) & (table.size - 1))
+      if (keys[table[slot] - 1] == key)
+        return table[slot] - 1;
+    table[slot] = keys.size + 1;
+    keys.push(key);
+    return keys.size - 1;
+  }
+};
+
+// Variables are numbered by their exact name, and share storage by their
+// key: integral names compare by value across types, as `tfunc::GetItem`
+// compares them with `==`.
+struct Variables {
+  Index names;
+  Index keys;
+  Buffer<unsigned> slots;
+  Buffer<Value> values;
+  // Interned tuples are named by their node alone, so their ids (plus one)
+  // are cached by node to skip hashing the name.
+  Buffer<unsigned> tuples;
+  // Per slot, one plus the name it was last stored through, and the slots in
+  // the order they were first stored to, so that a run can report its stores.
+  Buffer<unsigned> writers;
+  Buffer<unsigned> written;
+
+  static constexpr Value key_of(Value name) noexcept {
+    if (name.kind == Kind::Int)
+      return {Kind::Int, Repr::LongLong, 0, 0,
+              static_cast<unsigned long long>(numeric(name))};
+    return name;
+  }
+
+  constexpr unsigned id_of(Value name) {
+    if (name.kind == Kind::Tuple && !name.var) {
+      while (tuples.size <= name.bits)
+        tuples.push(0);
+      auto &cached = tuples[static_cast<unsigned>(name.bits)];
+      if (!cached)
+        cached = lookup(name) + 1;
+      return cached - 1;
+    }
+    return lookup(name);
+  }
+
+  constexpr unsigned lookup(Value name) {
+    auto const id = names.id_of(name);
+    if (id == slots.size) {
+      auto const slot = keys.id_of(key_of(name));
+      if (slot == values.size) {
+        values.push({});
+        writers.push(0);
+      }
+      slots.push(slot);
+    }
+    return id;
+  }
+
+  constexpr Value name(unsigned id) const noexcept { return names.keys[id]; }
+  constexpr Value get(unsigned id) const noexcept {
+    return values[slots[id]];
+  }
+  constexpr void set(unsigned id, Value value) {
+    auto const slot = slots[id];
+    values[slot] = value;
+    if (!writers[slot])
+      written.push(slot);
+    writers[slot] = id + 1;
+  }
+
+  // Sets a variable without reporting it as stored to.
+  constexpr void seed(unsigned id, Value value) noexcept {
+    values[slots[id]] = value;
+  }
+};
+
+} // namespace _impl_
+
+// Runs a compiled program over stdin, appending everything it prints to
+// `out`.
+struct Machine {
+  char const *input;
+  unsigned input_size;
+  unsigned cursor = 0;
+  Buffer<char> out;
+  Buffer<Value> stack;
+  Buffer<_impl_::Frame> frames;
+  _impl_::Interner nodes;
+  _impl_::Variables vars;
+
+  constexpr Value unbind(Value value) const noexcept {
+    while (value.kind == Kind::Bound)
+      value = nodes.child(value, 1);
+    value.var = 0;
+    return value;
+  }
+
+  // The value a variable was bound to, which may itself be bound.
+  constexpr Value bound_value(Value target) const noexcept {
+    if (target.kind == Kind::Bound)
+      return nodes.child(target, 1);
+    if (!target.var)
+      fault("dereference of a value that is not a variable");
+    target.var = 0;
+    return target;
+  }
+
+  constexpr Value integral(Value value) const noexcept {
+    value = unbind(value);
+    if (value.kind != Kind::Int)
+      fault("arithmetic on a value that is not an integer");
+    return value;
+  }
+
+  constexpr bool truth(Value value) const noexcept {
+    return _impl_::numeric(integral(value)) != 0;
+  }
+
+  constexpr Value load(Value name) {
+    auto const id = vars.id_of(name);
+    auto value = vars.get(id);
+    if (value.var || value.kind == Kind::Bound) {
+      Value const bound[] = {name, value};
+      return nodes.intern(Kind::Bound, bound, 2);
+    }
+    value.var = id + 1;
+    return value;
+  }
+
+  constexpr unsigned bound_var(Value target) {
+    if (target.kind == Kind::Bound)
+      return vars.id_of(nodes.child(target, 0));
+    if (!target.var)
+      fault("assignment to a value that is not a variable");
+    return target.var - 1;
+  }
+
+  constexpr Value bound_name(Value target) {
+    return vars.name(bound_var(target));
+  }
+
+  constexpr Value peek(Value offset) const noexcept {
+    auto const at = cursor + _impl_::numeric(integral(offset));
+    if (at < 0 || at >= input_size)
+      return {};
+    return _impl_::integer(Repr::Char, input[static_cast<unsigned>(at)]);
+  }
+
+  constexpr void advance(Value offset) noexcept {
+    auto const at = cursor + _impl_::numeric(integral(offset));
+    cursor = at < input_size ? static_cast<unsigned>(at) : input_size;
+  }
+
+  constexpr Value arithmetic(Operation op, Value lhs, Value rhs) const {
+    using namespace _impl_;
+    if (op == Operation::Eq || op == Operation::Ne) {
+      lhs = unbind(lhs);
+      rhs = unbind(rhs);
+      bool equal;
+      if (lhs.kind == Kind::Int && rhs.kind == Kind::Int) {
+        auto const type = common(lhs.repr, rhs.repr);
+        equal = integer(type, numeric(lhs)).bits ==
+                integer(type, numeric(rhs)).bits;
+      } else {
+        equal = lhs.kind != Kind::Str && lhs.kind != Kind::Ref &&
+                lhs.kind != Kind::Fn && lhs == rhs;
+      }
+      return boolean(equal == (op == Operation::Eq));
+    }
+    lhs = integral(lhs);
+    rhs = integral(rhs);
+    if (op == Operation::Shl || op == Operation::Shr) {
+      auto const type = promote(lhs.repr);
+      auto const x = numeric(integer(type, numeric(lhs)));
+      auto const n = static_cast<unsigned>(numeric(rhs));
+      return integer(type, op == Operation::Shl ? x << n : x >> n);
+    }
+    auto const type = common(lhs.repr, rhs.repr);
+    auto const x = numeric(integer(type, numeric(lhs)));
+    auto const y = numeric(integer(type, numeric(rhs)));
+    switch (op) {
+    case Operation::Add:
+      return exact(type, x + y);
+    case Operation::Sub:
+      return exact(type, x - y);
+    case Operation::Mul:
+      return exact(type, x * y);
+    case Operation::Div:
+      if (y == 0)
+        fault("division by zero");
+      return exact(type, x / y);
+    case Operation::Mod:
+      if (y == 0)
+        fault("division by zero");
+      return exact(type, x % y);
+    case Operation::Xor:
+      return integer(type, x ^ y);
+    case Operation::And:
+      return integer(type, x & y);
+    case Operation::Or:
+      return integer(type, x | y);
+    case Operation::Lt:
+      return boolean(x < y);
+    case Operation::Gt:
+      return boolean(x > y);
+    case Operation::Le:
+      return boolean(x <= y);
+    case Operation::Ge:
+      return boolean(x >= y);
+    default:
+      fault("unsupported binary operator");
+    }
+  }
+
+  constexpr Value unary(Operation op, Value arg) {
+    using namespace _impl_;
+    switch (op) {
+    case Operation::Deref:
+      if (arg.kind == Kind::Ref && !arg.var)
+        return load(nodes.child(arg, 0));
+      return bound_value(arg);
+    case Operation::AddressOf: {
+      Value const name[] = {bound_name(arg)};
+      return nodes.intern(Kind::Ref, name, 1);
+    }
+    case Operation::Pos:
+      arg = integral(arg);
+      return integer(promote(arg.repr), numeric(arg));
+    case Operation::Neg:
+      arg = integral(arg);
+      return exact(promote(arg.repr), -numeric(arg));
+    case Operation::Compl:
+      arg = integral(arg);
+      return integer(promote(arg.repr), ~numeric(arg));
+    case Operation::Not:
+      return boolean(!truth(arg));
+    default: {
+      auto const var = bound_var(arg);
+      auto const old = bound_value(arg);
+      if (old.kind != Kind::Int || old.repr == Repr::Bool || old.tag)
+        fault("increment of a value that is not an integer");
+      auto const step = op == Operation::PreInc || op == Operation::PostInc
+                            ? 1
+                            : -1;
+      auto const next = exact(promote(old.repr), numeric(old) + step);
+      auto const updated = integer(old.repr, numeric(next));
+      vars.set(var, updated);
+      return op == Operation::PreInc || op == Operation::PreDec ? updated
+                                                                : old;
+    }
+    }
+  }
+
+  constexpr Value update(Operation op, Value target, Value rhs) {
+    auto const var = bound_var(target);
+    auto const old = bound_value(target);
+    auto result = arithmetic(op, old, rhs);
+    if (old.kind == Kind::Int && !old.tag)
+      result = _impl_::integer(old.repr, _impl_::numeric(result));
+    vars.set(var, result);
+    return result;
+  }
+
+  constexpr Value index(Value head, Value const *args, unsigned n) {
+    if (head.var || head.kind == Kind::Bound) {
+      Value name[8];
+      if (n + 1 > 8)
+        fault("too many subscripts");
+      name[0] = bound_name(head);
+      for (unsigned i = 0; i < n; ++i)
+        name[i + 1] = args[i];
+      return load(nodes.intern(Kind::Tuple, name, n + 1));
+    }
+    fault("subscript of a value that is not a variable");
+  }
+
+  constexpr Value cast(Value value, Repr repr,
+                       unsigned long long tag) const noexcept {
+    return _impl_::integer(repr, _impl_::numeric(integral(value)), tag);
+  }
+
+  template <typename Program> constexpr void run(Program const &program) {
+    using namespace _impl_;
+    unsigned pc = 0;
+    // Nested so that no single loop runs into `-fconstexpr-loop-limit`.
+    for (;;) {
+      for (unsigned step = 0; step < (1u << 16); ++step) {
+        auto const &instr = program.code[pc++];
+        switch (instr.op) {
+        case Opcode::Push:
+          stack.push(program.constants[instr.a]);
+          break;
+        case Opcode::Pop:
+          stack.pop();
+          break;
+        case Opcode::Slide: {
+          auto const top = stack.pop();
+          stack.size -= instr.a;
+          stack.push(top);
+          break;
+        }
+        case Opcode::Tuple: {
+          stack.size -= instr.a;
+          auto const tuple =
+              nodes.intern(Kind::Tuple, stack.data + stack.size, instr.a);
+          stack.push(tuple);
+          break;
+        }
+        case Opcode::Load:
+          stack.back() = load(stack.back());
+          break;
+        case Opcode::Ref: {
+          Value const name[] = {stack.back()};
+          stack.back() = nodes.intern(Kind::Ref, name, 1);
+          break;
+        }
+        case Opcode::Store: {
+          auto const value = stack.pop();
+          vars.set(bound_var(stack.back()), value);
+          stack.back() = value;
+          break;
+        }
+        case Opcode::Drop: {
+          // Variables keep their slot, so a dropped one is reset to none,
+          // which is what reading a missing variable gives.
+          auto const id = vars.id_of(stack.back());
+          stack.back() = vars.get(id);
+          vars.set(id, {});
+          break;
+        }
+        case Opcode::Unary:
+          stack.back() = unary(static_cast<Operation>(instr.a), stack.back());
+          break;
+        case Opcode::Binary: {
+          auto const rhs = stack.pop();
+          stack.back() =
+              arithmetic(static_cast<Operation>(instr.a), stack.back(), rhs);
+          break;
+        }
+        case Opcode::Update: {
+          auto const rhs = stack.pop();
+          stack.back() =
+              update(static_cast<Operation>(instr.a), stack.back(), rhs);
+          break;
+        }
+        case Opcode::Index: {
+          stack.size -= instr.a;
+          auto const head = stack.data[stack.size - 1];
+          if (head.kind == Kind::Str && !head.var) {
+            auto const i = numeric(integral(stack.data[stack.size]));
+            if (i < 0 || i > static_cast<__int128>(head.tag))
+              fault("string subscript out of range");
+            stack.back() = integer(
+                Repr::Char, program.strings[head.bits + static_cast<unsigned>(i)]);
+          } else {
+            stack.back() = index(head, stack.data + stack.size, instr.a);
+          }
+          break;
+        }
+        case Opcode::Call: {
+          auto const fn = unbind(stack.data[stack.size - instr.a - 1]);
+          if (fn.kind != Kind::Fn || fn.tag != instr.a)
+            fault("call of a value that is not a matching function");
+          frames.push({pc, stack.size - instr.a});
+          pc = static_cast<unsigned>(fn.bits);
+          break;
+        }
+        case Opcode::Arg:
+          stack.push(stack.data[frames.back().base + instr.a]);
+          break;
+        case Opcode::Return: {
+          auto const result = stack.pop();
+          auto const frame = frames.pop();
+          stack.size = frame.base;
+          stack.back() = result;
+          pc = frame.ret;
+          break;
+        }
+        case Opcode::Cast:
+          stack.back() =
+              cast(stack.back(), static_cast<Repr>(instr.a), instr.b);
+          break;
+        case Opcode::Truth:
+          stack.back() = boolean(truth(stack.back()));
+          break;
+        case Opcode::Peek:
+          stack.back() = peek(stack.back());
+          break;
+        case Opcode::Advance:
+          advance(stack.back());
+          stack.back() = {};
+          break;
+        case Opcode::GetC:
+          stack.push(peek(integer(Repr::Int, 0)));
+          advance(integer(Repr::Int, 1));
+          break;
+        case Opcode::PutC:
+          out.push(static_cast<char>(integral(stack.back()).bits));
+          break;
+        case Opcode::Jump:
+          pc = instr.a;
+          break;
+        case Opcode::JumpUnless:
+          if (!truth(stack.pop()))
+            pc = instr.a;
+          break;
+        case Opcode::Halt:
+          return;
+        }
+      }
+    }
+  }
+};
+
+namespace _impl_ {
+
+// Output of a first run, kept whole when it fits.
+struct Preview {
+  static constexpr unsigned capacity = 1u << 12;
+
+  unsigned size;
+  char str[capacity];
+};
+
+template <auto code> struct Run {
+  static constexpr auto &program = compile<code>;
+
+  static constexpr Preview preview = [] {
+    Machine machine{detail::runtime::input.str, detail::runtime::input.size};
+    machine.run(program);
+    Preview preview{machine.out.size, {}};
+    for (unsigned i = 0; i < machine.out.size && i < Preview::capacity; ++i)
+      preview.str[i] = machine.out[i];
+    return preview;
+  }();
+
+  static constexpr unsigned size = preview.size;
+
+  // Only output longer than the preview costs a second run.
+  static constexpr auto result = [] {
+    char out[size + 1]{};
+    if constexpr (size <= Preview::capacity) {
+      for (unsigned i = 0; i < size; ++i)
+        out[i] = preview.str[i];
+    } else {
+      Machine machine{detail::runtime::input.str, detail::runtime::input.size};
+      machine.run(program);
+      for (unsigned i = 0; i < size; ++i)
+        out[i] = machine.out[i];
+    }
+    return detail::string::StringLiteral<size>(out);
+  }();
+};
+
+} // namespace _impl_
+
+template <auto code> static constexpr auto run = _impl_::Run<code>::result;
+
+} // namespace vm
+
+} // namespace lib
+
+} // namespace std
+} // namespace gil
+
+#endif // GIL_STD_VM_HPP_